@@ -0,0 +1,391 @@
+#include <stdafx.hpp>
+#include "block_cache.h"
+#include "cpu.h"
+
+/* Physical memory that can hold executable code. */
+const Range CODE_RAM = Range(0x00000000, 8 * 1024 * 1024LL);
+const Range CODE_BIOS = Range(0x1fc00000, 512 * 1024LL);
+const Range CODE_SCRATCHPAD = Range(0x1f800000, 1024LL);
+
+BlockCache::BlockCache(Bus* bus) :
+	bus(bus)
+{
+	/* One slot per instruction word. */
+	ram_blocks.resize(2048 * 1024 / 4);
+	bios_blocks.resize(512 * 1024 / 4);
+	scratchpad_blocks.resize(1024 / 4);
+}
+
+bool BlockCache::is_cacheable(uint addr)
+{
+	return CODE_RAM.contains(addr) || CODE_BIOS.contains(addr) ||
+		CODE_SCRATCHPAD.contains(addr);
+}
+
+/* Get the tracked page of a physical address. */
+/* The BIOS cannot be written so it is not tracked. */
+int BlockCache::code_page(uint addr)
+{
+	/* NOTE: RAM is mirrored four times in the first 8MB. */
+	if (CODE_RAM.contains(addr))
+		return (CODE_RAM.offset(addr) & 0x1fffff) >> CODE_PAGE_SHIFT;
+	else if (CODE_SCRATCHPAD.contains(addr))
+		return SCRATCHPAD_CODE_PAGE;
+	else
+		return -1;
+}
+
+BlockSlot* BlockCache::slot(uint addr)
+{
+	if (CODE_RAM.contains(addr))
+		return &ram_blocks[(CODE_RAM.offset(addr) & 0x1fffff) >> 2];
+	else if (CODE_BIOS.contains(addr))
+		return &bios_blocks[CODE_BIOS.offset(addr) >> 2];
+	else if (CODE_SCRATCHPAD.contains(addr))
+		return &scratchpad_blocks[CODE_SCRATCHPAD.offset(addr) >> 2];
+	else
+		return nullptr;
+}
+
+CachedBlock* BlockCache::find(uint addr)
+{
+	auto entry = slot(addr);
+	return (entry != nullptr ? entry->block.get() : nullptr);
+}
+
+CachedBlock* BlockCache::insert(uint addr, std::unique_ptr<CachedBlock> block)
+{
+	auto entry = slot(addr);
+	if (entry == nullptr)
+		return nullptr;
+
+	/* A block ending in a delay slot may cross into the next page. */
+	uint last = addr + (uint)(block->ops.size() - 1) * 4;
+	int first_page = code_page(addr), last_page = code_page(last);
+
+	register_page(entry, addr, first_page, SLOT_FIRST_PAGE);
+	if (last_page != first_page)
+		register_page(entry, addr, last_page, SLOT_NEXT_PAGE);
+
+	if (!(entry->lists & SLOT_ADDRS)) {
+		block_addrs.push_back(addr);
+		entry->lists |= SLOT_ADDRS;
+	}
+
+	entry->block = std::move(block);
+	return entry->block.get();
+}
+
+void BlockCache::register_page(BlockSlot* entry, uint addr, int page, SlotLists list)
+{
+	if (page < 0 || (entry->lists & list))
+		return;
+
+	page_blocks[page].push_back(addr);
+	entry->lists |= list;
+
+	if (!code_pages[page])
+		protect_page(page, true);
+}
+
+/* Drop the blocks of every page in [addr, addr + size). */
+void BlockCache::invalidate(uint addr, uint size)
+{
+	if (size == 0)
+		return;
+
+	int first = code_page(addr);
+	int last = code_page(addr + size - 1);
+	if (first < 0 || last < 0)
+		return;
+
+	for (int page = first; page <= last; page++) {
+		if (code_pages[page])
+			invalidate_page(page);
+	}
+}
+
+void BlockCache::invalidate_page(uint page)
+{
+	for (auto addr : page_blocks[page]) {
+		auto entry = slot(addr);
+		entry->lists &= ~(code_page(addr) == (int)page ? SLOT_FIRST_PAGE : SLOT_NEXT_PAGE);
+
+		if (entry->block == nullptr)
+			continue;
+
+		entry->block->valid = false;
+		retired.push_back(std::move(entry->block));
+	}
+
+	page_blocks[page].clear();
+	protect_page(page, false);
+}
+
+/* Writes to pages with code must go through Bus::write. */
+void BlockCache::protect_page(uint page, bool protect)
+{
+	uint addr = (page == SCRATCHPAD_CODE_PAGE ? CODE_SCRATCHPAD.start :
+		page << CODE_PAGE_SHIFT);
+
+	bus->protect_page(addr, protect);
+	code_pages[page] = protect;
+}
+
+void BlockCache::clear()
+{
+	/* Only visit the slots that were actually filled. */
+	for (auto addr : block_addrs) {
+		*slot(addr) = BlockSlot();
+	}
+
+	for (uint page = 0; page < CODE_PAGES; page++) {
+		page_blocks[page].clear();
+		if (code_pages[page])
+			protect_page(page, false);
+	}
+
+	block_addrs.clear();
+}
+
+/* Resolve the final handler of an instruction, including */
+/* the SPECIAL and coprocessor sub-tables. */
+CPUfunc CPU::decode(Instr instr)
+{
+	switch (instr.opcode()) {
+	case 0b000000: return special[instr.function()];
+	case 0b010000: return cop0_lookup[instr.rs()];
+	case 0b010010: return cop2_lookup[instr.rs()];
+	default: return lookup[instr.opcode()];
+	}
+}
+
+/* Check if the instruction transfers control. */
+bool BlockCache::is_jump(Instr instr)
+{
+	uint opcode = instr.opcode();
+
+	/* BCOND, J, JAL, BEQ, BNE, BLEZ, BGTZ. */
+	if (opcode >= 0b000001 && opcode <= 0b000111)
+		return true;
+	
+	/* JR, JALR. */
+	return opcode == 0 && (instr.function() == 0b001000 || instr.function() == 0b001001);
+}
+
+/* Check if the instruction always raises an exception. */
+bool BlockCache::is_trap(Instr instr)
+{
+	/* SYSCALL, BREAK. */
+	return instr.opcode() == 0 && (instr.function() == 0b001100 || instr.function() == 0b001101);
+}
+
+/* Classify an instruction of an idle loop body. Returns false */
+/* if it may have side effects, otherwise the registers it */
+/* reads and the one it writes (0 if none). */
+static bool idle_operands(Instr instr, uint& read1, uint& read2, uint& write, bool& load)
+{
+	read1 = read2 = write = 0;
+	load = false;
+
+	switch (instr.opcode()) {
+	case 0b000000:
+		switch (instr.function()) {
+		/* SLL, SRL, SRA. */
+		case 0b000000: case 0b000010: case 0b000011:
+			read1 = instr.rt(); write = instr.rd();
+			return true;
+		/* SLLV, SRLV, SRAV, ADDU, SUBU, AND, OR, XOR, NOR, SLT, SLTU. */
+		case 0b000100: case 0b000110: case 0b000111:
+		case 0b100001: case 0b100011: case 0b100100: case 0b100101:
+		case 0b100110: case 0b100111: case 0b101010: case 0b101011:
+			read1 = instr.rs(); read2 = instr.rt(); write = instr.rd();
+			return true;
+		default:
+			return false;
+		}
+	/* BLTZ and BGEZ, but not the linking variants. */
+	case 0b000001:
+		read1 = instr.rs();
+		return (instr.rt() & 0x1e) != 0x10;
+	/* BEQ, BNE. */
+	case 0b000100: case 0b000101:
+		read1 = instr.rs(); read2 = instr.rt();
+		return true;
+	/* BLEZ, BGTZ. */
+	case 0b000110: case 0b000111:
+		read1 = instr.rs();
+		return true;
+	/* ADDIU, SLTI, SLTIU, ANDI, ORI, XORI. */
+	case 0b001001: case 0b001010: case 0b001011:
+	case 0b001100: case 0b001101: case 0b001110:
+		read1 = instr.rs(); write = instr.rt();
+		return true;
+	/* LUI. */
+	case 0b001111:
+		write = instr.rt();
+		return true;
+	/* LB, LH, LW, LBU, LHU. */
+	case 0b100000: case 0b100001: case 0b100011:
+	case 0b100100: case 0b100101:
+		read1 = instr.rs(); write = instr.rt(); load = true;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Check if the block is a loop that branches back onto itself */
+/* and computes the same values on every iteration unless the */
+/* memory it reads changes. Running it again until the next */
+/* device event would then only burn cycles. */
+bool BlockCache::detect_idle_loop(CachedBlock* block)
+{
+	auto& ops = block->ops;
+	uint count = (uint)ops.size();
+	if (count < 2)
+		return false;
+
+	/* The branch must be the one before the delay slot */
+	/* and its target must be the start of the block. */
+	Instr branch = ops[count - 2].instr;
+	uint branch_pc = block->pc + (count - 2) * 4;
+	uint opcode = branch.opcode();
+	if (opcode < 0b000001 || opcode > 0b000111 || opcode == 0b000010 || opcode == 0b000011)
+		return false;
+
+	if (branch_pc + 4 + (branch.imm_s() << 2) != block->pc)
+		return false;
+
+	struct Operands {
+		uint read1, read2, write;
+		bool load;
+	};
+
+	std::vector<Operands> operands(count);
+	for (uint i = 0; i < count; i++) {
+		auto& op = operands[i];
+		if (!idle_operands(ops[i].instr, op.read1, op.read2, op.write, op.load))
+			return false;
+	}
+
+	/* Index after which each register holds its new value, */
+	/* loaded values are only visible one instruction later. */
+	/* One writer per register keeps the state at the end of */
+	/* an iteration equal to the values the iteration used. */
+	int visible[32];
+	std::fill(std::begin(visible), std::end(visible), -1);
+
+	for (uint i = 0; i < count; i++) {
+		uint reg = operands[i].write;
+		if (reg == 0)
+			continue;
+
+		if (visible[reg] != -1)
+			return false;
+
+		visible[reg] = (int)i + (operands[i].load ? 1 : 0);
+	}
+
+	/* Every register read must have been computed earlier */
+	/* in the same iteration, or never be written at all. */
+	std::vector<Instr> loads;
+	for (uint i = 0; i < count; i++) {
+		for (uint reg : { operands[i].read1, operands[i].read2 }) {
+			if (reg != 0 && visible[reg] >= (int)i)
+				return false;
+		}
+
+		if (operands[i].load)
+			loads.push_back(ops[i].instr);
+	}
+
+	block->idle_loads = std::move(loads);
+	return true;
+}
+
+CachedBlock* CPU::compile_block(uint addr)
+{
+	auto block = std::make_unique<CachedBlock>();
+	block->pc = addr;
+
+	bool delay_slot = false;
+	for (uint i = 0; i < MAX_BLOCK_SIZE; i++) {
+		uint op_addr = addr + i * 4;
+
+		Instr op;
+		op.value = bus->read(op_addr);
+		block->ops.push_back({ decode(op), op });
+
+		/* The delay slot is the last instruction of the block. */
+		if (delay_slot || BlockCache::is_trap(op))
+			break;
+
+		delay_slot = BlockCache::is_jump(op);
+
+		/* Do not let blocks span over 4KB pages. */
+		if (!delay_slot && ((op_addr + 4) & 0xfff) == 0)
+			break;
+
+		/* Or run past the end of the scratchpad. */
+		if (!delay_slot && !BlockCache::is_cacheable(bus->physical_addr(op_addr + 4)))
+			break;
+	}
+
+	block->idle = BlockCache::detect_idle_loop(block.get());
+
+	return block_cache.insert(bus->physical_addr(addr), std::move(block));
+}
+
+uint CPU::execute_block()
+{
+	/* Misaligned PCs and uncacheable code are interpreted. */
+	uint addr = bus->physical_addr(pc);
+	if ((pc & 0x3) != 0 || !BlockCache::is_cacheable(addr)) {
+		tick();
+		return 1;
+	}
+
+	/* No block is running, free the overwritten ones. */
+	if (!block_cache.retired.empty())
+		block_cache.retired.clear();
+
+	CachedBlock* block = block_cache.find(addr);
+	if (block == nullptr)
+		block = compile_block(pc);
+
+	/* Every instruction costs one cycle plus its fetch, charged */
+	/* before it runs so timers read by it see the same cycle. */
+	uint start = pc;
+	uint op_cycles = 1 + fetch_cycles(start);
+	uint executed = 0;
+	for (auto& op : block->ops) {
+		/* Leave the block when an exception redirected the flow */
+		/* or when the block overwrote its own code. */
+		if (pc != start + executed * 4 || !block->valid)
+			break;
+
+		cycles += op_cycles;
+		instr = op.instr;
+		advance();
+
+		(this->*op.handler)();
+
+		handle_load_delay();
+		executed++;
+	}
+
+	return executed;
+}
+
+void CPU::set_mode(CPUMode _mode)
+{
+	flush_cache();
+	mode = _mode;
+}
+
+void CPU::flush_cache()
+{
+	block_cache.clear();
+	recompiler.reset();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cpu/instr.hpp>
+
+class CPU;
+class Bus;
+typedef void (CPU::*CPUfunc)();
+typedef uint (*JitFunc)(CPU* cpu);
+
+/* Maximum number of instructions in a block. */
+constexpr uint MAX_BLOCK_SIZE = 64;
+
+/* Writes are tracked per 4KB page of RAM. The */
+/* scratchpad is tracked as one extra page at the end. */
+constexpr uint CODE_PAGE_SHIFT = 12;
+constexpr uint RAM_CODE_PAGES = (2048 * 1024) >> CODE_PAGE_SHIFT;
+constexpr uint SCRATCHPAD_CODE_PAGE = RAM_CODE_PAGES;
+constexpr uint CODE_PAGES = RAM_CODE_PAGES + 1;
+
+/* A single instruction with its handler already resolved. */
+struct DecodedOp {
+	CPUfunc handler;
+	Instr instr;
+};
+
+/* A straight-line run of instructions that ends after */
+/* the first branch and its delay slot. */
+struct CachedBlock {
+	uint pc;
+	std::vector<DecodedOp> ops;
+
+	/* Cleared when the code is overwritten. */
+	bool valid = true;
+
+	/* Host code, only used by the recompiler. */
+	JitFunc code = nullptr;
+
+	/* Set when the block is a loop that only polls memory, */
+	/* with the loads it polls through. */
+	bool idle = false;
+	std::vector<Instr> idle_loads;
+};
+
+/* Lists a slot's address was added to, so it is */
+/* only added once however often it is recompiled. */
+enum SlotLists : ubyte {
+	SLOT_ADDRS = 1 << 0,
+	SLOT_FIRST_PAGE = 1 << 1,
+	SLOT_NEXT_PAGE = 1 << 2
+};
+
+struct BlockSlot {
+	std::unique_ptr<CachedBlock> block;
+	ubyte lists = 0;
+};
+
+/* Blocks are keyed by the physical address of their first */
+/* instruction, so KUSEG/KSEG0/KSEG1 aliases share one entry. */
+class BlockCache {
+public:
+	BlockCache(Bus* bus);
+	~BlockCache() = default;
+
+	static bool is_cacheable(uint addr);
+	static bool is_jump(Instr instr);
+	static bool is_trap(Instr instr);
+	static bool detect_idle_loop(CachedBlock* block);
+	static int code_page(uint addr);
+
+	CachedBlock* find(uint addr);
+	CachedBlock* insert(uint addr, std::unique_ptr<CachedBlock> block);
+	void invalidate(uint addr, uint size);
+	void clear();
+
+	/* Check if a physical address holds compiled code. */
+	inline bool is_code(uint addr)
+	{
+		int page = code_page(addr);
+		return page >= 0 && code_pages[page];
+	}
+
+private:
+	BlockSlot* slot(uint addr);
+	void register_page(BlockSlot* entry, uint addr, int page, SlotLists list);
+	void invalidate_page(uint page);
+	void protect_page(uint page, bool protect);
+
+public:
+	Bus* bus;
+
+	std::vector<BlockSlot> ram_blocks;
+	std::vector<BlockSlot> bios_blocks;
+	std::vector<BlockSlot> scratchpad_blocks;
+	std::vector<uint> block_addrs;
+
+	/* One flag per page, set while the page holds blocks. */
+	ubyte code_pages[CODE_PAGES] = {};
+	std::vector<uint> page_blocks[CODE_PAGES];
+
+	/* Invalidated blocks may still be executing, */
+	/* they are freed before the next block runs. */
+	std::vector<std::unique_ptr<CachedBlock>> retired;
+};
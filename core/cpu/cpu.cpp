@@ -2,7 +2,7 @@
 #include "cpu.h"
 
 CPU::CPU(Bus* bus) :
-    gte(this)
+    gte(this), block_cache(bus), recompiler(this)
 {
     this->bus = bus;
 
@@ -18,57 +18,215 @@ CPU::CPU(Bus* bus) :
 
 CPU::~CPU()
 {
-    if (log_file.is_open()) log_file.close();
+    tracer.close();
 }
 
 void CPU::tick()
 {
-    /* Fetch next instruction. */
-    fetch();
+    step<false>();
+}
 
-    //if (pc == 0x8002dde4) __debugbreak();
+/* Execute one instruction. The tracing variant is a separate */
+/* instantiation so the normal path does not test for it. */
+template <bool Trace>
+void CPU::step()
+{
+    /* Every instruction costs one cycle plus its fetch. */
+    cycles += 1 + fetch_cycles(pc);
 
-    if (should_log) {
-        if (!log_file.is_open()) log_file.open("log.txt");
+    /* Fetch next instruction. */
+    fetch();
 
-        log_file << "PC: 0x" << std::hex << pc << '\n';
+    /* Loads and stores, including LWC2/SWC2. The address is */
+    /* taken before the instruction can change its base. */
+    bool access = false;
+    uint addr = 0;
+    if constexpr (Trace) {
+        uint opcode = instr.opcode();
+        access = (opcode >= 0x20 && opcode <= 0x2e) || opcode == 0x32 || opcode == 0x3a;
+        addr = registers[instr.rs()] + instr.imm_s();
     }
 
     /* Execute it. */
-    auto& handler = lookup[instr.opcode()];
-    if (handler != nullptr)
-        handler();
-    else
-        exception(ExceptionType::IllegalInstr);
+    (this->*lookup[instr.opcode()])();
+
+    if constexpr (Trace) {
+        TraceRecord entry = {};
+        entry.pc = current_pc;
+        entry.instr = instr.value;
+
+        /* Prefer the result of the instruction itself, */
+        /* otherwise the load that lands in this step. */
+        if (tracer.registers) {
+            MEM& delta = (write_back.reg != 0 ? write_back : memory_load);
+            entry.reg = (ubyte)delta.reg;
+            entry.value = delta.value;
+        }
+
+        entry.access = tracer.accesses && access;
+        entry.addr = (entry.access ? addr : 0);
+
+        tracer.record(entry);
+    }
 
     /* Apply pending load delays. */
     handle_load_delay();
+}
+
+/* Step count instructions one by one. */
+template <bool Trace>
+uint CPU::step_count(uint count)
+{
+    for (uint executed = 0; executed < count; executed++) {
+        /* Natively handled calls return straight to ra. */
+        if (before_step())
+            continue;
+
+        step<Trace>();
+    }
+
+    return count;
+}
+
+/* Step instructions one by one until the cycle counter reaches target. */
+template <bool Trace>
+void CPU::step_until(ulong target)
+{
+    while (cycles < target) {
+        if (before_step())
+            continue;
+
+        step<Trace>();
+    }
+}
 
-    //force_test();
+/* Open the trace file the first time it is needed. */
+bool CPU::start_trace()
+{
+    return tracer.is_open() || tracer.open("trace.bin");
 }
 
-void CPU::force_test()
+uint CPU::run(uint count)
 {
-    if (pc == 0x80030000 && exe) {
-        PSEXELoadInfo psxexe_load_info;
-        if (bus->loadEXE("./tests/timers/timers.exe", psxexe_load_info)) {
-            pc = psxexe_load_info.pc;
-            next_pc = pc + 4;
+    uint executed = 0;
 
-            printf("[CPU] Sideloading exe file.\n");
+    /* Tracing records every instruction, so it */
+    /* always steps through the interpreter. */
+    if (should_log && start_trace()) {
+        executed = step_count<true>(count);
+    }
+    else if (mode == CPUMode::Interpreter) {
+        executed = step_count<false>(count);
+    }
+    else {
+        /* Whole blocks are executed, so we may overshoot. */
+        while (executed < count) {
+            if (before_step())
+                continue;
+
+            if (mode == CPUMode::Recompiler)
+                executed += execute_recompiled();
+            else
+                executed += execute_block();
+        }
+    }
 
-            registers[28] = psxexe_load_info.r28;
-            
-            if (psxexe_load_info.r29 != 0) {
-                registers[29] = psxexe_load_info.r29;
-                registers[30] = psxexe_load_info.r30;
-            }
+    return executed;
+}
 
-            exe = false;
+/* Run until the cycle counter reaches target. */
+void CPU::run_until(ulong target)
+{
+    if (should_log && start_trace()) {
+        step_until<true>(target);
+    }
+    else if (mode == CPUMode::Interpreter) {
+        step_until<false>(target);
+    }
+    else {
+        /* Whole blocks are executed, so we may overshoot. */
+        while (cycles < target) {
+            if (before_step())
+                continue;
+
+            uint start = pc;
+            if (mode == CPUMode::Recompiler)
+                execute_recompiled();
+            else
+                execute_block();
+
+            /* The block branched back onto itself. */
+            if (pc == start && idle_skip)
+                skip_idle(target);
         }
     }
 }
 
+/* Check if nothing but a device event can change a polled address. */
+static bool is_idle_source(uint addr)
+{
+    return addr < 0x00800000 || (addr >= 0x1f800000 && addr < 0x1f800400) ||
+        (addr >= 0x1fc00000 && addr < 0x1fc80000) || INTERRUPT.contains(addr) ||
+        addr == 0x1f8010f4 || addr == 0x1f801814;
+}
+
+/* When the block that just ran is an idle loop, every iteration */
+/* until the next event would read the same values, so jump */
+/* straight to it. The polled addresses are checked each time */
+/* since their base registers are only known at runtime. */
+void CPU::skip_idle(ulong target)
+{
+    CachedBlock* block = block_cache.find(bus->physical_addr(pc));
+    if (irq_pending || block == nullptr || !block->idle || block->pc != pc || target == ULLONG_MAX)
+        return;
+
+    for (auto load : block->idle_loads) {
+        uint addr = bus->physical_addr(registers[load.rs()] + load.imm_s());
+        if (!is_idle_source(addr))
+            return;
+    }
+
+    if (cycles < target) {
+        idle_cycles += target - cycles;
+        idle_skips++;
+        cycles = target;
+    }
+}
+
+/* Start a program loaded to RAM, like the shell would. */
+void CPU::sideload(const PSEXELoadInfo& info)
+{
+    pc = info.pc;
+    next_pc = pc + 4;
+
+    registers[28] = info.r28;
+
+    if (info.r29 != 0) {
+        registers[29] = info.r29;
+        registers[30] = info.r30;
+    }
+}
+
+/* Called once the BIOS reaches the shell. Starts the requested */
+/* executable or the disc. Without a disc the shell keeps */
+/* running, a requested executable that fails stops the run. */
+void CPU::boot()
+{
+    fast_boot = false;
+
+    PSEXELoadInfo info;
+    bool loaded = (boot_exe.empty() ? bus->boot_disc(info) : bus->loadEXE(boot_exe, info));
+
+    if (loaded) {
+        sideload(info);
+    }
+    else if (!boot_exe.empty()) {
+        printf("[CPU] Failed to load %s.\n", boot_exe.c_str());
+        stopped = true;
+        exit_code = 1;
+    }
+}
+
 void CPU::break_on_next_tick()
 {
     should_break = true;
@@ -92,9 +250,14 @@ void CPU::reset()
     in_delay_slot_took_branch = false;
 }
 
+/* Take the pending interrupt, called by the run loops */
+/* between instructions or blocks when irq_pending is set. */
 void CPU::handle_interrupts()
 {
-    uint load = read(pc);
+    if (!irq_pending)
+        return;
+
+    uint load = bus->read(pc);
     uint instr = load >> 26;
 
     /* If it is a GTE instruction do not execute interrupt! */
@@ -102,27 +265,32 @@ void CPU::handle_interrupts()
         return;
     }
 
+    exception(ExceptionType::Interrupt);
+}
+
+/* Recompute the interrupt state after i_stat, i_mask, */
+/* SR or CAUSE changed. */
+void CPU::update_irq()
+{
     /* Update external irq bit in CAUSE register. */
     /* This bit is set when an interrupt is pending. */
     bool pending = (i_stat & i_mask) != 0;
     cop0.cause.IP = util::set_bit(cop0.cause.IP, 0, pending);
 
-    /* Get interrupt state from Cop0. */
-    bool irq_enabled = cop0.sr.IEc;
-
     uint irq_mask = (cop0.sr.raw >> 8) & 0xFF;
-    uint irq_pending = (cop0.cause.raw >> 8) & 0xFF;
+    uint irq_bits = (cop0.cause.raw >> 8) & 0xFF;
 
-    /* If pending and enabled, handle the interrupt. */
-    if (irq_enabled && (irq_mask & irq_pending) > 0) {
-        exception(ExceptionType::Interrupt);
-    }
+    irq_pending = cop0.sr.IEc && (irq_mask & irq_bits) != 0;
 }
 
 void CPU::fetch()
 {
-    instr.value = read(pc);
+    instr.value = bus->read(pc);
+    advance();
+}
 
+void CPU::advance()
+{
     /* Update PC. */
     current_pc = pc;
     pc = next_pc;
@@ -165,11 +333,14 @@ void CPU::write_irq(uint address, uint value)
         i_mask = value & 0x7FF;
     else
         return;
+
+    update_irq();
 }
 
 void CPU::trigger(Interrupt interrupt)
 {
     i_stat |= (1 << (uint)interrupt);
+    update_irq();
 }
 
 void CPU::op_mfc2()
@@ -227,6 +398,9 @@ void CPU::exception(ExceptionType cause, uint cop)
     /* Select exception address. */
     pc = exception_addr[cop0.sr.BEV];
     next_pc = pc + 4;
+
+    /* Interrupts are now disabled. */
+    update_irq();
 }
 
 void CPU::handle_load_delay()
@@ -275,7 +449,7 @@ void CPU::op_swr()
         break;
     }
 
-    bus->write(aligned_addr, value);
+    write(aligned_addr, value);
 }
 
 void CPU::op_swl()
@@ -299,14 +473,14 @@ void CPU::op_swl()
         value = registers[instr.rt()]; break;
     }
 
-    bus->write(aligned_addr, value);
+    write(aligned_addr, value);
 }
 
 void CPU::op_lwr()
 {
     uint addr = registers[instr.rs()] + instr.imm_s();
     uint aligned_addr = addr & 0xFFFFFFFC;
-    uint aligned_load = bus->read(aligned_addr);
+    uint aligned_load = read(aligned_addr);
 
     uint value = 0;
     uint LRValue = registers[instr.rt()];
@@ -337,7 +511,7 @@ void CPU::op_lwl()
 {
     uint addr = registers[instr.rs()] + instr.imm_s();
     uint aligned_addr = addr & 0xFFFFFFFC;
-    uint aligned_load = bus->read(aligned_addr);
+    uint aligned_load = read(aligned_addr);
 
     uint value = 0;
     uint LRValue = registers[instr.rt()];
@@ -382,8 +556,22 @@ void CPU::op_sub()
         exception(ExceptionType::Overflow, instr.id());
 }
 
+/* Multiply latency depends on the magnitude of rs. */
+static uint mult_cycles(uint value)
+{
+    if (value < 0x800)
+        return 6;
+    else if (value < 0x100000)
+        return 9;
+    else
+        return 13;
+}
+
 void CPU::op_mult()
 {
+    uint rs = registers[instr.rs()];
+    cycles += mult_cycles((int)rs < 0 ? ~rs : rs);
+
     int64_t value = (int64_t)(int)registers[instr.rs()] * (int64_t)(int)registers[instr.rt()]; //sign extend to pass amidog cpu test
 
     hi = (uint)(value >> 32);
@@ -402,6 +590,8 @@ void CPU::op_xor()
 
 void CPU::op_multu()
 {
+    cycles += mult_cycles(registers[instr.rs()]);
+
     ulong value = (ulong)registers[instr.rs()] * (ulong)registers[instr.rt()]; //sign extend to pass amidog cpu test
 
     hi = (uint)(value >> 32);
@@ -429,7 +619,7 @@ void CPU::op_lh()
         uint addr = registers[instr.rs()] + instr.imm_s();
 
         if ((addr & 0x1) == 0) {
-            uint value = (uint)(short)bus->read<ushort>(addr);
+            uint value = (uint)(short)read<ushort>(addr);
             load(instr.rt(), value);
         }
         else {
@@ -450,7 +640,7 @@ void CPU::op_lhu()
         uint addr = registers[instr.rs()] + instr.imm_s();
 
         if ((addr & 0x1) == 0) {
-            uint value = bus->read<ushort>(addr);
+            uint value = read<ushort>(addr);
             load(instr.rt(), value);
         }
         else {
@@ -467,6 +657,8 @@ void CPU::op_rfe()
     /* Shift kernel/user mode bits back. */
     cop0.sr.raw &= ~(uint)0xF;
     cop0.sr.raw |= mode >> 2;
+
+    update_irq();
 }
 
 void CPU::op_mthi()
@@ -497,6 +689,8 @@ void CPU::op_mfhi()
 
 void CPU::op_divu()
 {
+    cycles += DIV_CYCLES;
+
     uint n = registers[instr.rs()];
     uint d = registers[instr.rt()];
 
@@ -528,6 +722,8 @@ void CPU::op_mflo()
 
 void CPU::op_div()
 {
+    cycles += DIV_CYCLES;
+
     int n = (int)registers[instr.rs()];
     int d = (int)registers[instr.rt()];
 
@@ -581,7 +777,7 @@ void CPU::op_jalr()
 void CPU::op_lbu()
 {
     if (!cop0.sr.IsC) {
-        uint value = bus->read<ubyte>(registers[instr.rs()] + instr.imm_s());
+        uint value = read<ubyte>(registers[instr.rs()] + instr.imm_s());
         load(instr.rt(), value);
     }
 }
@@ -651,7 +847,7 @@ void CPU::op_swc2()
     uint addr = registers[instr.rs()] + instr.imm_s();
 
     if ((addr & 0x3) == 0) {
-        bus->write(addr, gte.read_data(instr.rt()));
+        write(addr, gte.read_data(instr.rt()));
     }
     else {
         cop0.BadA = addr;
@@ -670,7 +866,7 @@ void CPU::op_beq()
 void CPU::op_lb()
 {
     if (!cop0.sr.IsC) {
-        uint value = (uint)(byte)bus->read<ubyte>(registers[instr.rs()] + instr.imm_s());
+        uint value = (uint)(byte)read<ubyte>(registers[instr.rs()] + instr.imm_s());
         load(instr.rt(), value);
     }
 }
@@ -685,7 +881,7 @@ void CPU::op_jr()
 void CPU::op_sb()
 {
     if (!cop0.sr.IsC)
-        bus->write<ubyte>(registers[instr.rs()] + instr.imm_s(), (ubyte)registers[instr.rt()]);
+        write<ubyte>(registers[instr.rs()] + instr.imm_s(), (ubyte)registers[instr.rt()]);
 }
 
 void CPU::op_andi()
@@ -705,7 +901,7 @@ void CPU::op_sh()
         uint addr = registers[instr.rs()] + instr.imm_s();
 
         if ((addr & 0x1) == 0) {
-            bus->write<ushort>(addr, (ushort)registers[instr.rt()]);
+            write<ushort>(addr, (ushort)registers[instr.rt()]);
         }
         else {
             cop0.BadA = addr;
@@ -731,7 +927,7 @@ void CPU::op_lw()
         uint addr = registers[instr.rs()] + instr.imm_s();
 
         if ((addr & 0x3) == 0) {
-            uint value = bus->read(addr);
+            uint value = read(addr);
             load(instr.rt(), value);
         }
         else {
@@ -782,12 +978,14 @@ void CPU::op_mtc0()
     }
 
     uint irq_mask = cop0.sr.Sw | (cop0.sr.Intr >> 2);
-    uint irq_pending = cop0.cause.Sw | (cop0.cause.IP >> 2);
+    uint irq_bits = cop0.cause.Sw | (cop0.cause.IP >> 2);
 
-    if (!prev_IEC && cop0.sr.IEc && (irq_mask & irq_pending) > 0) {
+    if (!prev_IEC && cop0.sr.IEc && (irq_mask & irq_bits) > 0) {
         pc = next_pc;
         exception(ExceptionType::Interrupt, instr.id());
     }
+
+    update_irq();
 }
 
 void CPU::op_or()
@@ -828,7 +1026,7 @@ void CPU::op_sw()
         uint addr = registers[r] + i;
 
         if ((addr & 0x3) == 0) {
-            bus->write(addr, registers[instr.rt()]);
+            write(addr, registers[instr.rt()]);
         }
         else {
             cop0.BadA = addr;
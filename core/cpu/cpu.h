@@ -3,13 +3,32 @@
 #include <cpu/gte.h>
 #include <cpu/instr.hpp>
 #include <cpu/cop0.h>
+#include <cpu/block_cache.h>
+#include <cpu/recompiler.h>
+#include <cpu/tracer.h>
+#include <cpu/kernel_calls.h>
+#include <cpu/kernel_hle.h>
 
 struct MEM {
     uint reg = 0;
     uint value = 0;
 };
 
-typedef std::function<void()> CPUfunc;
+/* Available execution backends. */
+enum class CPUMode {
+    Interpreter,
+    CachedInterpreter,
+    Recompiler
+};
+
+/* Extra cycles of a memory access, by physical region. */
+/* Stores go through the write buffer and only stall on MMIO. */
+constexpr uint RAM_ACCESS_CYCLES = 4;
+constexpr uint BIOS_ACCESS_CYCLES = 24;
+constexpr uint MMIO_ACCESS_CYCLES = 2;
+
+/* Latency of DIV/DIVU, MULT depends on its operand. */
+constexpr uint DIV_CYCLES = 36;
 
 /* Memory Ranges. */
 const Range KSEG = Range(0x00000000, 2048 * 1024 * 1024LL);
@@ -18,6 +37,10 @@ const Range KSEG1 = Range(0xA0000000, 512 * 1024 * 1024LL);
 const Range KSEG2 = Range(0xC0000000, 1024 * 1024 * 1024LL);
 const Range INTERRUPT = Range(0x1f801070, 8);
 
+/* Address where the BIOS starts the shell. Programs */
+/* and disc executables are started from there. */
+constexpr uint SHELL_ENTRY = 0x80030000;
+
 /* A class implemeting the MIPS R3000A CPU. */
 class CPU {
 public:
@@ -26,13 +49,38 @@ public:
 
     /* CPU functionality. */
     void tick();
+    uint run(uint count);
+    void run_until(ulong target);
+    bool start_trace();
+
+    template <bool Trace>
+    void step();
+    template <bool Trace>
+    uint step_count(uint count);
+    template <bool Trace>
+    void step_until(ulong target);
+    void skip_idle(ulong target);
+    bool before_step();
     void reset();
     void fetch();
+    void advance();
     void branch();
     void register_opcodes();
     void handle_interrupts();
+    void update_irq();
     void handle_load_delay();
-    void force_test();
+    void sideload(const PSEXELoadInfo& info);
+    void boot();
+
+    /* Cached interpreter. */
+    uint execute_block();
+    CachedBlock* compile_block(uint addr);
+    CPUfunc decode(Instr instr);
+    void set_mode(CPUMode mode);
+    void flush_cache();
+
+    /* Recompiler. */
+    uint execute_recompiled();
 
     void break_on_next_tick();
 
@@ -47,12 +95,18 @@ public:
     template <typename T = uint>
     void write(uint addr, T data);
 
+    /* Cycle costs. */
+    static uint read_cycles(uint addr);
+    static uint write_cycles(uint addr);
+    static uint fetch_cycles(uint addr);
+
     uint read_irq(uint address);
     void write_irq(uint address, uint value);
     void trigger(Interrupt interrupt);
 
     /* Opcodes. */
     void op_special(); void op_cop2(); void op_cop0();
+    void op_gte(); void op_illegal();
     void op_lwc2(); void op_swc2(); void op_mfc2(); void op_mtc2();
     void op_cfc2(); void op_ctc2();
 
@@ -95,10 +149,32 @@ public:
 
     /* Registers. */
     uint current_pc, pc, next_pc;
-    uint i_stat, i_mask;
+    uint i_stat = 0, i_mask = 0;
+
+    /* Set while an enabled interrupt is waiting, so the */
+    /* run loops only test one flag per block. */
+    bool irq_pending = false;
     uint registers[32] = {};
     uint hi, lo;
 
+    /* Cycles executed since power on. */
+    ulong cycles = 0;
+
+    /* Idle loop skipping and the cycles it saved. */
+    bool idle_skip = true;
+    ulong idle_cycles = 0;
+    ulong idle_skips = 0;
+
+    /* Skip the shell and boot boot_exe, or the */
+    /* disc if it is empty, when it is reached. */
+    bool fast_boot = false;
+    std::string boot_exe;
+
+    /* Set when the run can't go on, like when boot_exe */
+    /* fails to load. The emulator exits with exit_code. */
+    bool stopped = false;
+    int exit_code = 0;
+
     /* Flow control. */
     bool is_branch, is_delay_slot;
     bool took_branch;
@@ -107,8 +183,9 @@ public:
     /* Debugging. */
     bool should_break = false;
     bool should_log = false;
-    bool exe = true;
-    std::ofstream log_file;
+    Tracer tracer;
+    KernelCallTracer kernel_calls;
+    KernelHLE kernel_hle;
     int cycle_int = 20000;
     bool flip = true;
 
@@ -128,14 +205,39 @@ public:
     /* Current instruction. */
     Instr instr;
 
-    /* Opcode lookup table. */
-    std::unordered_map<uint, CPUfunc> lookup, special;
+    /* Execution backend. */
+    CPUMode mode = CPUMode::Interpreter;
+    BlockCache block_cache;
+    Recompiler recompiler;
+
+    /* Opcode lookup tables. */
+    /* NOTE: these are indexed directly by the opcode */
+    /* field, unused entries point to op_illegal. */
+    CPUfunc lookup[64], special[64];
+    CPUfunc cop0_lookup[32], cop2_lookup[32];
 };
 
+/* Checks made before every instruction or block. Returns */
+/* true if a natively handled kernel call returned to ra. */
+inline bool CPU::before_step()
+{
+    if (irq_pending)
+        handle_interrupts();
+
+    if (fast_boot && pc == SHELL_ENTRY)
+        boot();
+
+    if (kernel_calls.enabled)
+        kernel_calls.check(this, pc);
+
+    return kernel_hle.enabled && kernel_hle.check(this, pc);
+}
+
 template<typename T>
 inline T CPU::read(uint addr)
 {
     /* Read from main RAM or IO. */
+    cycles += read_cycles(addr);
     return bus->read<T>(addr);
 }
 
@@ -143,5 +245,38 @@ template<typename T>
 inline void CPU::write(uint addr, T data)
 {
     /* Write to main RAM or IO. */
+    cycles += write_cycles(addr);
     bus->write<T>(addr, data);
 }
+
+inline uint CPU::read_cycles(uint addr)
+{
+    uint abs_addr = addr & 0x1fffffff;
+
+    if (abs_addr < 0x800000)
+        return RAM_ACCESS_CYCLES;
+    else if ((abs_addr >> 19) == (0x1fc00000 >> 19))
+        return BIOS_ACCESS_CYCLES;
+    /* The scratchpad is on chip and costs nothing. */
+    else if ((abs_addr >> 12) == (0x1f800000 >> 12))
+        return 0;
+    else
+        return MMIO_ACCESS_CYCLES;
+}
+
+inline uint CPU::write_cycles(uint addr)
+{
+    uint abs_addr = addr & 0x1fffffff;
+
+    if (abs_addr < 0x800000 || (abs_addr >> 12) == (0x1f800000 >> 12))
+        return 0;
+    else
+        return MMIO_ACCESS_CYCLES;
+}
+
+/* KSEG1 bypasses the instruction cache, which */
+/* is assumed to always hit everywhere else. */
+inline uint CPU::fetch_cycles(uint addr)
+{
+    return ((addr >> 29) == 5 ? read_cycles(addr) : 0);
+}
@@ -0,0 +1,132 @@
+#include <stdafx.hpp>
+#include "disassembler.h"
+#include <cstdarg>
+
+static const char* reg_names[32] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static std::string format(const char* fmt, ...)
+{
+	char buffer[64];
+
+	va_list args;
+	va_start(args, fmt);
+	std::vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	return buffer;
+}
+
+static std::string special(Instr instr)
+{
+	const char* rs = reg_names[instr.rs()];
+	const char* rt = reg_names[instr.rt()];
+	const char* rd = reg_names[instr.rd()];
+
+	switch (instr.function()) {
+	case 0x00:
+		if (instr.value == 0) return "nop";
+		return format("sll %s, %s, %u", rd, rt, instr.sa());
+	case 0x02: return format("srl %s, %s, %u", rd, rt, instr.sa());
+	case 0x03: return format("sra %s, %s, %u", rd, rt, instr.sa());
+	case 0x04: return format("sllv %s, %s, %s", rd, rt, rs);
+	case 0x06: return format("srlv %s, %s, %s", rd, rt, rs);
+	case 0x07: return format("srav %s, %s, %s", rd, rt, rs);
+	case 0x08: return format("jr %s", rs);
+	case 0x09: return format("jalr %s, %s", rd, rs);
+	case 0x0c: return "syscall";
+	case 0x0d: return "break";
+	case 0x10: return format("mfhi %s", rd);
+	case 0x11: return format("mthi %s", rs);
+	case 0x12: return format("mflo %s", rd);
+	case 0x13: return format("mtlo %s", rs);
+	case 0x18: return format("mult %s, %s", rs, rt);
+	case 0x19: return format("multu %s, %s", rs, rt);
+	case 0x1a: return format("div %s, %s", rs, rt);
+	case 0x1b: return format("divu %s, %s", rs, rt);
+	case 0x20: return format("add %s, %s, %s", rd, rs, rt);
+	case 0x21: return format("addu %s, %s, %s", rd, rs, rt);
+	case 0x22: return format("sub %s, %s, %s", rd, rs, rt);
+	case 0x23: return format("subu %s, %s, %s", rd, rs, rt);
+	case 0x24: return format("and %s, %s, %s", rd, rs, rt);
+	case 0x25: return format("or %s, %s, %s", rd, rs, rt);
+	case 0x26: return format("xor %s, %s, %s", rd, rs, rt);
+	case 0x27: return format("nor %s, %s, %s", rd, rs, rt);
+	case 0x2a: return format("slt %s, %s, %s", rd, rs, rt);
+	case 0x2b: return format("sltu %s, %s, %s", rd, rs, rt);
+	default: return format("illegal 0x%08x", instr.value);
+	}
+}
+
+static std::string coprocessor(Instr instr)
+{
+	uint cop = instr.id();
+	const char* rt = reg_names[instr.rt()];
+
+	/* GTE commands carry their own opcode in the low bits. */
+	if (cop == 2 && (instr.rs() & 0x10))
+		return format("gte 0x%07x", instr.value & 0x1ffffff);
+
+	if (cop == 0 && instr.rs() == 0x10 && instr.function() == 0x10)
+		return "rfe";
+
+	switch (instr.rs()) {
+	case 0x00: return format("mfc%u %s, $%u", cop, rt, instr.rd());
+	case 0x02: return format("cfc%u %s, $%u", cop, rt, instr.rd());
+	case 0x04: return format("mtc%u %s, $%u", cop, rt, instr.rd());
+	case 0x06: return format("ctc%u %s, $%u", cop, rt, instr.rd());
+	default: return format("cop%u 0x%07x", cop, instr.value & 0x1ffffff);
+	}
+}
+
+std::string disassemble(Instr instr, uint pc)
+{
+	const char* rs = reg_names[instr.rs()];
+	const char* rt = reg_names[instr.rt()];
+	short imm = (short)instr.imm();
+	uint target = pc + 4 + (instr.imm_s() << 2);
+
+	switch (instr.opcode()) {
+	case 0x00: return special(instr);
+	case 0x01: {
+		static const char* names[] = { "bltz", "bgez", "bltzal", "bgezal" };
+		uint kind = (instr.rt() & 1) | ((instr.rt() & 0x1e) == 0x10 ? 2 : 0);
+		return format("%s %s, 0x%08x", names[kind], rs, target);
+	}
+	case 0x02: return format("j 0x%08x", ((pc + 4) & 0xf0000000) | (instr.addr() << 2));
+	case 0x03: return format("jal 0x%08x", ((pc + 4) & 0xf0000000) | (instr.addr() << 2));
+	case 0x04: return format("beq %s, %s, 0x%08x", rs, rt, target);
+	case 0x05: return format("bne %s, %s, 0x%08x", rs, rt, target);
+	case 0x06: return format("blez %s, 0x%08x", rs, target);
+	case 0x07: return format("bgtz %s, 0x%08x", rs, target);
+	case 0x08: return format("addi %s, %s, %d", rt, rs, imm);
+	case 0x09: return format("addiu %s, %s, %d", rt, rs, imm);
+	case 0x0a: return format("slti %s, %s, %d", rt, rs, imm);
+	case 0x0b: return format("sltiu %s, %s, %d", rt, rs, imm);
+	case 0x0c: return format("andi %s, %s, 0x%04x", rt, rs, instr.imm());
+	case 0x0d: return format("ori %s, %s, 0x%04x", rt, rs, instr.imm());
+	case 0x0e: return format("xori %s, %s, 0x%04x", rt, rs, instr.imm());
+	case 0x0f: return format("lui %s, 0x%04x", rt, instr.imm());
+	case 0x10: case 0x11: case 0x12: case 0x13:
+		return coprocessor(instr);
+	case 0x20: return format("lb %s, %d(%s)", rt, imm, rs);
+	case 0x21: return format("lh %s, %d(%s)", rt, imm, rs);
+	case 0x22: return format("lwl %s, %d(%s)", rt, imm, rs);
+	case 0x23: return format("lw %s, %d(%s)", rt, imm, rs);
+	case 0x24: return format("lbu %s, %d(%s)", rt, imm, rs);
+	case 0x25: return format("lhu %s, %d(%s)", rt, imm, rs);
+	case 0x26: return format("lwr %s, %d(%s)", rt, imm, rs);
+	case 0x28: return format("sb %s, %d(%s)", rt, imm, rs);
+	case 0x29: return format("sh %s, %d(%s)", rt, imm, rs);
+	case 0x2a: return format("swl %s, %d(%s)", rt, imm, rs);
+	case 0x2b: return format("sw %s, %d(%s)", rt, imm, rs);
+	case 0x2e: return format("swr %s, %d(%s)", rt, imm, rs);
+	case 0x32: return format("lwc2 $%u, %d(%s)", instr.rt(), imm, rs);
+	case 0x3a: return format("swc2 $%u, %d(%s)", instr.rt(), imm, rs);
+	default: return format("illegal 0x%08x", instr.value);
+	}
+}
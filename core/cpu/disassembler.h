@@ -0,0 +1,7 @@
+#pragma once
+#include <cpu/instr.hpp>
+#include <string>
+
+/* Format an instruction as MIPS assembly. pc is the address */
+/* of the instruction, used to resolve branch targets. */
+std::string disassemble(Instr instr, uint pc);
@@ -73,10 +73,10 @@ void GTE::execute(Instr instr)
     /* Convert to GTE command format. */
     command.raw = instr.value;
 
-    auto& handler = lookup[command.opcode];
+    auto handler = lookup[command.opcode];
     
     if (handler != nullptr)
-        handler();
+        (this->*handler)();
     else {
         std::cout << "Unhandled GTE command: 0x" << std::hex << command.opcode << '\n';
         exit(0);
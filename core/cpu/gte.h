@@ -101,9 +101,10 @@ union GTECommand {
 	};
 };
 
-typedef std::function<void()> GTEFunc;
-
 class CPU;
+class GTE;
+typedef void (GTE::*GTEFunc)();
+
 class GTE {
 public:
 	GTE(CPU* _cpu);
@@ -178,6 +179,7 @@ public:
 	uint FLAG;
 
 	GTECommand command;
-	std::unordered_map<uint, GTEFunc> lookup;
+	GTEFunc lookup[64] = {};
+	ubyte latency[64] = {};
 	//GTECommand command;
 };
\ No newline at end of file
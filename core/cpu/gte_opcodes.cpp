@@ -1,7 +1,7 @@
 #include <stdafx.hpp>
 #include "gte.h"
 
-#define GTE_BIND(x) std::bind(&GTE::x, this)
+#define GTE_BIND(x) &GTE::x
 
 void GTE::register_opcodes()
 {
@@ -23,4 +23,14 @@ void GTE::register_opcodes()
 	lookup[0x16] = GTE_BIND(op_ncdt);
 	lookup[0x1b] = GTE_BIND(op_nccs);
 	lookup[0x1e] = GTE_BIND(op_ncs);
+
+	/* Cycles taken by each command. */
+	latency[0x01] = 15; latency[0x06] = 8; latency[0x0c] = 6;
+	latency[0x10] = 8; latency[0x11] = 8; latency[0x12] = 8;
+	latency[0x13] = 19; latency[0x14] = 13; latency[0x16] = 44;
+	latency[0x1b] = 17; latency[0x1c] = 11; latency[0x1e] = 14;
+	latency[0x20] = 30; latency[0x28] = 5; latency[0x29] = 8;
+	latency[0x2a] = 17; latency[0x2d] = 5; latency[0x2e] = 6;
+	latency[0x30] = 23; latency[0x3d] = 5; latency[0x3e] = 5;
+	latency[0x3f] = 39;
 }
\ No newline at end of file
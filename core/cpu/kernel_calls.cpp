@@ -0,0 +1,168 @@
+#include <stdafx.hpp>
+#include "kernel_calls.h"
+#include <cpu/cpu.h>
+
+struct KernelFunction {
+	ubyte number;
+	const char* name;
+};
+
+/* Names of the commonly used functions, see psx-spx. */
+static const KernelFunction a0_functions[] = {
+	{ 0x00, "FileOpen" }, { 0x01, "FileSeek" }, { 0x02, "FileRead" }, { 0x03, "FileWrite" },
+	{ 0x04, "FileClose" }, { 0x05, "FileIoctl" }, { 0x06, "exit" }, { 0x07, "FileGetDeviceFlag" },
+	{ 0x08, "FileGetc" }, { 0x09, "FilePutc" }, { 0x0a, "todigit" }, { 0x0b, "atof" },
+	{ 0x0c, "strtoul" }, { 0x0d, "strtol" }, { 0x0e, "abs" }, { 0x0f, "labs" },
+	{ 0x10, "atoi" }, { 0x11, "atol" }, { 0x12, "atob" }, { 0x13, "SaveState" },
+	{ 0x14, "RestoreState" }, { 0x15, "strcat" }, { 0x16, "strncat" }, { 0x17, "strcmp" },
+	{ 0x18, "strncmp" }, { 0x19, "strcpy" }, { 0x1a, "strncpy" }, { 0x1b, "strlen" },
+	{ 0x1c, "index" }, { 0x1d, "rindex" }, { 0x1e, "strchr" }, { 0x1f, "strrchr" },
+	{ 0x20, "strpbrk" }, { 0x21, "strspn" }, { 0x22, "strcspn" }, { 0x23, "strtok" },
+	{ 0x24, "strstr" }, { 0x25, "toupper" }, { 0x26, "tolower" }, { 0x27, "bcopy" },
+	{ 0x28, "bzero" }, { 0x29, "bcmp" }, { 0x2a, "memcpy" }, { 0x2b, "memset" },
+	{ 0x2c, "memmove" }, { 0x2d, "memcmp" }, { 0x2e, "memchr" }, { 0x2f, "rand" },
+	{ 0x30, "srand" }, { 0x31, "qsort" }, { 0x32, "strtod" }, { 0x33, "malloc" },
+	{ 0x34, "free" }, { 0x35, "lsearch" }, { 0x36, "bsearch" }, { 0x37, "calloc" },
+	{ 0x38, "realloc" }, { 0x39, "InitHeap" }, { 0x3a, "SystemErrorExit" }, { 0x3b, "std_in_getchar" },
+	{ 0x3c, "std_out_putchar" }, { 0x3d, "std_in_gets" }, { 0x3e, "std_out_puts" }, { 0x3f, "printf" },
+	{ 0x40, "SystemErrorUnresolvedException" }, { 0x41, "LoadExeHeader" }, { 0x42, "LoadExeFile" },
+	{ 0x43, "DoExecute" }, { 0x44, "FlushCache" }, { 0x45, "init_a0_b0_c0_vectors" },
+	{ 0x46, "GPU_dw" }, { 0x47, "gpu_send_dma" }, { 0x48, "SendGP1Command" }, { 0x49, "GPU_cw" },
+	{ 0x4a, "GPU_cwp" }, { 0x4b, "send_gpu_linked_list" }, { 0x4c, "gpu_abort_dma" },
+	{ 0x4d, "GetGPUStatus" }, { 0x4e, "gpu_sync" }, { 0x51, "LoadAndExecute" },
+	{ 0x54, "CdInit" }, { 0x55, "_bu_init" }, { 0x56, "CdRemove" }, { 0x72, "CdRemove" },
+	{ 0x78, "CdAsyncSeekL" }, { 0x7c, "CdAsyncGetStatus" }, { 0x7e, "CdAsyncReadSector" },
+	{ 0x81, "CdAsyncSetMode" }, { 0x96, "AddCDROMDevice" }, { 0x97, "AddMemCardDevice" },
+	{ 0x98, "AddDuartTtyDevice" }, { 0x99, "AddDummyTtyDevice" }, { 0x9c, "SetConf" },
+	{ 0x9d, "GetConf" }, { 0x9f, "SetMemSize" }, { 0xa0, "WarmBoot" },
+	{ 0xa1, "SystemErrorBootOrDiskFailure" }, { 0xa2, "EnqueueCdIntr" }, { 0xa3, "DequeueCdIntr" },
+	{ 0xa4, "CdGetLbn" }, { 0xa5, "CdReadSector" }, { 0xa6, "CdGetStatus" },
+	{ 0xab, "_card_info" }, { 0xac, "_card_load" }, { 0xad, "_card_auto" }
+};
+
+static const KernelFunction b0_functions[] = {
+	{ 0x00, "alloc_kernel_memory" }, { 0x01, "free_kernel_memory" }, { 0x02, "init_timer" },
+	{ 0x03, "get_timer" }, { 0x04, "enable_timer_irq" }, { 0x05, "disable_timer_irq" },
+	{ 0x06, "restart_timer" }, { 0x07, "DeliverEvent" }, { 0x08, "OpenEvent" },
+	{ 0x09, "CloseEvent" }, { 0x0a, "WaitEvent" }, { 0x0b, "TestEvent" },
+	{ 0x0c, "EnableEvent" }, { 0x0d, "DisableEvent" }, { 0x0e, "OpenThread" },
+	{ 0x0f, "CloseThread" }, { 0x10, "ChangeThread" }, { 0x12, "InitPad" },
+	{ 0x13, "StartPad" }, { 0x14, "StopPad" }, { 0x15, "OutdatedPadInitAndStart" },
+	{ 0x16, "OutdatedPadGetButtons" }, { 0x17, "ReturnFromException" },
+	{ 0x18, "SetDefaultExitFromException" }, { 0x19, "SetCustomExitFromException" },
+	{ 0x20, "UnDeliverEvent" }, { 0x32, "FileOpen" }, { 0x33, "FileSeek" },
+	{ 0x34, "FileRead" }, { 0x35, "FileWrite" }, { 0x36, "FileClose" },
+	{ 0x37, "FileIoctl" }, { 0x38, "exit" }, { 0x39, "FileGetDeviceFlag" },
+	{ 0x3a, "FileGetc" }, { 0x3b, "FilePutc" }, { 0x3c, "std_in_getchar" },
+	{ 0x3d, "std_out_putchar" }, { 0x3e, "std_in_gets" }, { 0x3f, "std_out_puts" },
+	{ 0x40, "chdir" }, { 0x41, "FormatDevice" }, { 0x42, "firstfile" },
+	{ 0x43, "nextfile" }, { 0x44, "FileRename" }, { 0x45, "FileDelete" },
+	{ 0x46, "FileUndelete" }, { 0x47, "AddDevice" }, { 0x48, "RemoveDevice" },
+	{ 0x49, "PrintInstalledDevices" }, { 0x4a, "InitCard" }, { 0x4b, "StartCard" },
+	{ 0x4c, "StopCard" }, { 0x4e, "write_card_sector" }, { 0x4f, "read_card_sector" },
+	{ 0x50, "allow_new_card" }, { 0x51, "Krom2RawAdd" }, { 0x54, "GetLastError" },
+	{ 0x55, "GetLastFileError" }, { 0x56, "GetC0Table" }, { 0x57, "GetB0Table" },
+	{ 0x58, "get_bu_callback_port" }, { 0x59, "testdevice" }, { 0x5b, "ChangeClearPad" },
+	{ 0x5c, "get_card_status" }, { 0x5d, "wait_card_status" }
+};
+
+static const KernelFunction c0_functions[] = {
+	{ 0x00, "EnqueueTimerAndVblankIrqs" }, { 0x01, "EnqueueSyscallHandler" },
+	{ 0x02, "SysEnqIntRP" }, { 0x03, "SysDeqIntRP" }, { 0x04, "get_free_EvCB_slot" },
+	{ 0x05, "get_free_TCB_slot" }, { 0x06, "ExceptionHandler" },
+	{ 0x07, "InstallExceptionHandlers" }, { 0x08, "SysInitMemory" },
+	{ 0x09, "SysInitKernelVariables" }, { 0x0a, "ChangeClearRCnt" }, { 0x0c, "InitDefInt" },
+	{ 0x0d, "SetIrqAutoAck" }, { 0x12, "InstallDevices" }, { 0x13, "FlushStdInOutPut" },
+	{ 0x15, "tty_cdevinput" }, { 0x16, "tty_cdevscan" }, { 0x17, "tty_circgetc" },
+	{ 0x18, "tty_circputc" }, { 0x19, "ioabort" }, { 0x1a, "set_card_find_mode" },
+	{ 0x1b, "KernelRedirect" }, { 0x1c, "AdjustA0Table" }, { 0x1d, "get_card_find_mode" }
+};
+
+/* Returns null for functions without a known name. */
+const char* KernelCallTracer::name(KernelTable table, uint function)
+{
+	auto find = [&](const auto& functions) -> const char* {
+		for (auto& entry : functions) {
+			if (entry.number == function)
+				return entry.name;
+		}
+
+		return nullptr;
+	};
+
+	switch (table) {
+	case KernelTable::A0: return find(a0_functions);
+	case KernelTable::B0: return find(b0_functions);
+	case KernelTable::C0: return find(c0_functions);
+	default: return nullptr;
+	}
+}
+
+void KernelCallTracer::enter(CPU* cpu, KernelTable table)
+{
+	uint function = cpu->registers[9] & 0xff;
+	auto& entry = stats[(uint)table][function];
+
+	entry.calls++;
+	std::copy(cpu->registers + 4, cpu->registers + 8, entry.args);
+
+	if (pending.size() == KERNEL_CALL_DEPTH)
+		pending.erase(pending.begin());
+
+	pending.push_back({ &entry, cpu->registers[31], cpu->cycles });
+}
+
+void KernelCallTracer::leave(CPU* cpu)
+{
+	auto& call = pending.back();
+	call.stats->cycles += cpu->cycles - call.start;
+
+	pending.pop_back();
+}
+
+void KernelCallTracer::clear()
+{
+	for (auto& table : stats)
+		std::fill(std::begin(table), std::end(table), KernelCallStats());
+
+	pending.clear();
+}
+
+bool KernelCallTracer::write_json(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	static const char* tables[] = { "A0", "B0", "C0" };
+
+	std::fprintf(file, "[\n");
+
+	bool first = true;
+	for (uint table = 0; table < (uint)KernelTable::Count; table++) {
+		for (uint function = 0; function < 256; function++) {
+			auto& entry = stats[table][function];
+			if (entry.calls == 0)
+				continue;
+
+			const char* known = name((KernelTable)table, function);
+
+			std::fprintf(file, "%s  { \"table\": \"%s\", \"function\": %u, \"name\": ", (first ? "" : ",\n"),
+				tables[table], function);
+			if (known != nullptr)
+				std::fprintf(file, "\"%s\"", known);
+			else
+				std::fprintf(file, "null");
+
+			std::fprintf(file, ", \"calls\": %llu, \"cycles\": %llu, \"args\": [%u, %u, %u, %u] }",
+				(unsigned long long)entry.calls, (unsigned long long)entry.cycles,
+				entry.args[0], entry.args[1], entry.args[2], entry.args[3]);
+
+			first = false;
+		}
+	}
+
+	std::fprintf(file, "\n]\n");
+	std::fclose(file);
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <utility/types.hpp>
+#include <string>
+#include <vector>
+
+/* Maximum number of unfinished calls that are tracked. Calls */
+/* that never return to ra, like ReturnFromException, are */
+/* dropped once the stack is full. */
+constexpr uint KERNEL_CALL_DEPTH = 32;
+
+/* The three BIOS function tables, reached by jumping to */
+/* 0xA0, 0xB0 or 0xC0 with the function number in t1. */
+enum class KernelTable : ubyte {
+	A0, B0, C0,
+	Count
+};
+
+struct KernelCallStats {
+	ulong calls = 0;
+	ulong cycles = 0;
+
+	/* a0-a3 of the latest call. */
+	uint args[4] = {};
+};
+
+class CPU;
+
+/* Counts the kernel calls, the cycles spent until they return */
+/* to ra and their arguments. The run loops only call check() */
+/* while enabled is set, once per block or instruction. */
+class KernelCallTracer {
+public:
+	KernelCallTracer() = default;
+	~KernelCallTracer() = default;
+
+	inline void check(CPU* cpu, uint pc);
+	void clear();
+
+	static const char* name(KernelTable table, uint function);
+	bool write_json(const std::string& path);
+
+private:
+	void enter(CPU* cpu, KernelTable table);
+	void leave(CPU* cpu);
+
+public:
+	bool enabled = false;
+	KernelCallStats stats[(uint)KernelTable::Count][256];
+
+private:
+	struct PendingCall {
+		KernelCallStats* stats;
+		uint ra;
+		ulong start;
+	};
+
+	std::vector<PendingCall> pending;
+};
+
+inline void KernelCallTracer::check(CPU* cpu, uint pc)
+{
+	if (!pending.empty() && pc == pending.back().ra)
+		leave(cpu);
+
+	/* The entry points are at the same physical */
+	/* address in every segment. */
+	switch (pc & 0x1fffffff) {
+	case 0xa0: return enter(cpu, KernelTable::A0);
+	case 0xb0: return enter(cpu, KernelTable::B0);
+	case 0xc0: return enter(cpu, KernelTable::C0);
+	default: return;
+	}
+}
@@ -0,0 +1,516 @@
+#include <stdafx.hpp>
+#include "kernel_hle.h"
+#include <cpu/cpu.h>
+
+/* Event control blocks, see psx-spx. The kernel keeps the */
+/* table address and size in bytes at these RAM addresses. */
+constexpr uint EVCB_TABLE_ADDR = 0x120;
+constexpr uint EVCB_SIZE = 0x1c;
+constexpr uint EVENT_HANDLE = 0xf1000000;
+
+enum EventStatus : uint {
+	EventFree = 0x0000,
+	EventDisabled = 0x1000,
+	EventBusy = 0x2000,
+	EventReady = 0x4000
+};
+
+enum EventMode : uint {
+	EventCallback = 0x1000,
+	EventMarkReady = 0x2000
+};
+
+/* Words of an EvCB. */
+enum EventField : uint {
+	EventClass, EventStatusWord, EventSpec, EventModeWord, EventFunc
+};
+
+KernelHLE::KernelHLE()
+{
+	auto add = [&](KernelTable table, uint function, KernelHandler handler) {
+		handlers[(uint)table][function] = handler;
+		functions[(uint)table][function] = true;
+	};
+
+	add(KernelTable::A0, 0x1b, &KernelHLE::a0_strlen);
+	add(KernelTable::A0, 0x28, &KernelHLE::a0_bzero);
+	add(KernelTable::A0, 0x2a, &KernelHLE::a0_memcpy);
+	add(KernelTable::A0, 0x2b, &KernelHLE::a0_memset);
+	add(KernelTable::A0, 0x3c, &KernelHLE::a0_putchar);
+	add(KernelTable::A0, 0x3e, &KernelHLE::a0_puts);
+	add(KernelTable::A0, 0x3f, &KernelHLE::a0_printf);
+	add(KernelTable::A0, 0x44, &KernelHLE::a0_flush_cache);
+
+	add(KernelTable::B0, 0x07, &KernelHLE::b0_deliver_event);
+	add(KernelTable::B0, 0x08, &KernelHLE::b0_open_event);
+	add(KernelTable::B0, 0x09, &KernelHLE::b0_close_event);
+	add(KernelTable::B0, 0x0a, &KernelHLE::b0_wait_event);
+	add(KernelTable::B0, 0x0b, &KernelHLE::b0_test_event);
+	add(KernelTable::B0, 0x0c, &KernelHLE::b0_enable_event);
+	add(KernelTable::B0, 0x0d, &KernelHLE::b0_disable_event);
+	add(KernelTable::B0, 0x20, &KernelHLE::b0_undeliver_event);
+	add(KernelTable::B0, 0x3d, &KernelHLE::a0_putchar);
+	add(KernelTable::B0, 0x3f, &KernelHLE::a0_puts);
+}
+
+bool KernelHLE::supported(KernelTable table, uint function)
+{
+	return handlers[(uint)table][function] != nullptr;
+}
+
+bool KernelHLE::call(CPU* cpu, KernelTable table)
+{
+	uint function = cpu->registers[9] & 0xff;
+
+	KernelHandler handler = handlers[(uint)table][function];
+	if (handler == nullptr || !functions[(uint)table][function])
+		return false;
+
+	/* Land a load from the delay slot of the jump here, */
+	/* it would have before the first BIOS instruction. */
+	cpu->registers[cpu->memory_load.reg] = cpu->memory_load.value;
+	cpu->memory_load.reg = 0;
+	cpu->registers[0] = 0;
+
+	return (this->*handler)(cpu);
+}
+
+/* Return to the caller like the BIOS function would. */
+void KernelHLE::finish(CPU* cpu, uint result, uint words)
+{
+	cpu->registers[2] = result;
+	cpu->pc = cpu->registers[31];
+	cpu->next_pc = cpu->pc + 4;
+	cpu->cycles += KERNEL_HLE_CALL_CYCLES + words * KERNEL_HLE_WORD_CYCLES;
+
+	calls++;
+}
+
+/* Host pointer to a guest range, null unless it lies in RAM. */
+ubyte* KernelHLE::guest(CPU* cpu, uint addr, uint size)
+{
+	uint physical = cpu->bus->physical_addr(addr);
+	if (physical >= 4 * GUEST_RAM_SIZE)
+		return nullptr;
+
+	uint offset = physical & (GUEST_RAM_SIZE - 1);
+	if (size > GUEST_RAM_SIZE - offset)
+		return nullptr;
+
+	return cpu->bus->ram + offset;
+}
+
+bool KernelHLE::guest_string(CPU* cpu, uint addr, std::string& string)
+{
+	ubyte* start = guest(cpu, addr, 1);
+	if (start == nullptr)
+		return false;
+
+	ubyte* end = cpu->bus->ram + GUEST_RAM_SIZE;
+	ubyte* terminator = (ubyte*)std::memchr(start, 0, end - start);
+	if (terminator == nullptr)
+		return false;
+
+	string.assign((const char*)start, terminator - start);
+	return true;
+}
+
+/* Drop compiled code over a range written from the host. */
+void KernelHLE::written(CPU* cpu, void* host, uint size)
+{
+	cpu->bus->invalidate_code((uint)((ubyte*)host - cpu->bus->ram), size);
+}
+
+/* The EvCB table and its number of entries. */
+uint* KernelHLE::event_table(CPU* cpu, uint& count)
+{
+	uint table, size;
+	std::memcpy(&table, cpu->bus->ram + EVCB_TABLE_ADDR, 4);
+	std::memcpy(&size, cpu->bus->ram + EVCB_TABLE_ADDR + 4, 4);
+
+	count = size / EVCB_SIZE;
+	return (uint*)guest(cpu, table, count * EVCB_SIZE);
+}
+
+/* The words of an open or free event, null for bad handles. */
+uint* KernelHLE::event_block(CPU* cpu, uint event)
+{
+	uint count;
+	uint* events = event_table(cpu, count);
+
+	uint index = event & 0xffff;
+	if (events == nullptr || (event & 0xffff0000) != EVENT_HANDLE || index >= count)
+		return nullptr;
+
+	return events + index * (EVCB_SIZE / 4);
+}
+
+bool KernelHLE::a0_memcpy(CPU* cpu)
+{
+	uint dst = cpu->registers[4], src = cpu->registers[5];
+	int size = (int)cpu->registers[6];
+
+	if (dst == 0 || src == 0) {
+		finish(cpu, 0, 0);
+		return true;
+	}
+
+	if (size > 0) {
+		ubyte* to = guest(cpu, dst, size);
+		ubyte* from = guest(cpu, src, size);
+		if (to == nullptr || from == nullptr)
+			return false;
+
+		/* The BIOS copies forward a byte at a time, */
+		/* which repeats the source when they overlap. */
+		if (to > from && to < from + size) {
+			for (int i = 0; i < size; i++)
+				to[i] = from[i];
+		}
+		else {
+			std::memmove(to, from, size);
+		}
+
+		written(cpu, to, size);
+	}
+
+	finish(cpu, dst, std::max(size, 0) / 4);
+	return true;
+}
+
+bool KernelHLE::a0_memset(CPU* cpu)
+{
+	uint dst = cpu->registers[4];
+	int size = (int)cpu->registers[6];
+
+	if (dst == 0) {
+		finish(cpu, 0, 0);
+		return true;
+	}
+
+	if (size > 0) {
+		ubyte* to = guest(cpu, dst, size);
+		if (to == nullptr)
+			return false;
+
+		std::memset(to, cpu->registers[5] & 0xff, size);
+		written(cpu, to, size);
+	}
+
+	finish(cpu, dst, std::max(size, 0) / 4);
+	return true;
+}
+
+bool KernelHLE::a0_bzero(CPU* cpu)
+{
+	uint dst = cpu->registers[4];
+	int size = (int)cpu->registers[5];
+
+	if (dst == 0 || size <= 0) {
+		finish(cpu, 0, 0);
+		return true;
+	}
+
+	ubyte* to = guest(cpu, dst, size);
+	if (to == nullptr)
+		return false;
+
+	std::memset(to, 0, size);
+	written(cpu, to, size);
+
+	finish(cpu, dst, size / 4);
+	return true;
+}
+
+bool KernelHLE::a0_strlen(CPU* cpu)
+{
+	if (cpu->registers[4] == 0) {
+		finish(cpu, 0, 0);
+		return true;
+	}
+
+	std::string string;
+	if (!guest_string(cpu, cpu->registers[4], string))
+		return false;
+
+	finish(cpu, string.size(), string.size() / 4);
+	return true;
+}
+
+/* Code writes always reach the block cache, */
+/* so there is nothing left to flush. */
+bool KernelHLE::a0_flush_cache(CPU* cpu)
+{
+	finish(cpu, cpu->registers[2], 0);
+	return true;
+}
+
+bool KernelHLE::a0_putchar(CPU* cpu)
+{
+	std::fputc(cpu->registers[4] & 0xff, sink);
+
+	finish(cpu, cpu->registers[4] & 0xff, 0);
+	return true;
+}
+
+bool KernelHLE::a0_puts(CPU* cpu)
+{
+	std::string string;
+	if (!guest_string(cpu, cpu->registers[4], string))
+		return false;
+
+	std::fputs(string.c_str(), sink);
+
+	finish(cpu, 1, string.size() / 4);
+	return true;
+}
+
+/* Format with the host printf, one conversion at a time. Anything */
+/* it does not know, like '*' widths, is left to the BIOS. */
+bool KernelHLE::a0_printf(CPU* cpu)
+{
+	std::string format;
+	if (!guest_string(cpu, cpu->registers[4], format))
+		return false;
+
+	/* Arguments after a1-a3 follow the home area on the stack. */
+	uint arg = 1;
+	auto next = [&](uint& value) {
+		if (arg < 4) {
+			value = cpu->registers[4 + arg++];
+			return true;
+		}
+
+		ubyte* word = guest(cpu, cpu->registers[29] + arg++ * 4, 4);
+		if (word == nullptr)
+			return false;
+
+		std::memcpy(&value, word, 4);
+		return true;
+	};
+
+	std::string output;
+
+	/* Formats one argument onto the output, however wide it gets. */
+	auto append = [&](const std::string& spec, auto value) {
+		int length = std::snprintf(nullptr, 0, spec.c_str(), value);
+		if (length < 0)
+			return false;
+
+		size_t start = output.size();
+		output.resize(start + length + 1);
+		std::snprintf(&output[start], length + 1, spec.c_str(), value);
+		output.resize(start + length);
+		return true;
+	};
+
+	for (size_t i = 0; i < format.size(); i++) {
+		if (format[i] != '%') {
+			output += format[i];
+			continue;
+		}
+
+		/* Flags, width and precision are passed through, */
+		/* the length modifiers do not matter on 32 bits. */
+		std::string spec = "%";
+		for (i++; i < format.size() && std::strchr("-+ #0123456789.lh", format[i]) != nullptr; i++) {
+			if (format[i] != 'l' && format[i] != 'h')
+				spec += format[i];
+		}
+
+		if (i == format.size())
+			return false;
+
+		char conversion = format[i];
+		uint value = 0;
+
+		bool formatted = false;
+		switch (conversion) {
+		case '%':
+			output += '%';
+			continue;
+		case 'd': case 'i': case 'c':
+			formatted = next(value) && append(spec + conversion, (int)value);
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			formatted = next(value) && append(spec + conversion, value);
+			break;
+		case 'p':
+			formatted = next(value) && append(spec + 'x', value);
+			break;
+		case 's': {
+			std::string string;
+			formatted = next(value) && guest_string(cpu, value, string) &&
+				append(spec + 's', string.c_str());
+			break;
+		}
+		default:
+			return false;
+		}
+
+		if (!formatted)
+			return false;
+	}
+
+	std::fwrite(output.data(), 1, output.size(), sink);
+
+	finish(cpu, output.size(), (format.size() + output.size()) / 4);
+	return true;
+}
+
+bool KernelHLE::b0_deliver_event(CPU* cpu)
+{
+	uint count;
+	uint* events = event_table(cpu, count);
+	if (events == nullptr)
+		return false;
+
+	auto matches = [&](uint* event) {
+		return event[EventStatusWord] == EventBusy && event[EventClass] == cpu->registers[4] &&
+			event[EventSpec] == cpu->registers[5];
+	};
+
+	/* Callbacks are guest code, so let the BIOS deliver those. */
+	for (uint i = 0; i < count; i++) {
+		uint* event = events + i * (EVCB_SIZE / 4);
+		if (matches(event) && event[EventModeWord] == EventCallback)
+			return false;
+	}
+
+	for (uint i = 0; i < count; i++) {
+		uint* event = events + i * (EVCB_SIZE / 4);
+		if (matches(event) && event[EventModeWord] == EventMarkReady)
+			event[EventStatusWord] = EventReady;
+	}
+
+	written(cpu, events, count * EVCB_SIZE);
+
+	finish(cpu, cpu->registers[2], count * EVCB_SIZE / 4);
+	return true;
+}
+
+bool KernelHLE::b0_undeliver_event(CPU* cpu)
+{
+	uint count;
+	uint* events = event_table(cpu, count);
+	if (events == nullptr)
+		return false;
+
+	for (uint i = 0; i < count; i++) {
+		uint* event = events + i * (EVCB_SIZE / 4);
+		if (event[EventStatusWord] == EventReady && event[EventModeWord] == EventMarkReady &&
+			event[EventClass] == cpu->registers[4] && event[EventSpec] == cpu->registers[5])
+			event[EventStatusWord] = EventBusy;
+	}
+
+	written(cpu, events, count * EVCB_SIZE);
+
+	finish(cpu, cpu->registers[2], count * EVCB_SIZE / 4);
+	return true;
+}
+
+bool KernelHLE::b0_open_event(CPU* cpu)
+{
+	uint count;
+	uint* events = event_table(cpu, count);
+	if (events == nullptr)
+		return false;
+
+	for (uint i = 0; i < count; i++) {
+		uint* event = events + i * (EVCB_SIZE / 4);
+		if (event[EventStatusWord] != EventFree)
+			continue;
+
+		event[EventClass] = cpu->registers[4];
+		event[EventSpec] = cpu->registers[5];
+		event[EventModeWord] = cpu->registers[6];
+		event[EventFunc] = cpu->registers[7];
+		event[EventStatusWord] = EventDisabled;
+
+		written(cpu, event, EVCB_SIZE);
+
+		finish(cpu, EVENT_HANDLE | i, i * EVCB_SIZE / 4);
+		return true;
+	}
+
+	finish(cpu, 0xffffffff, count * EVCB_SIZE / 4);
+	return true;
+}
+
+bool KernelHLE::b0_close_event(CPU* cpu)
+{
+	uint* event = event_block(cpu, cpu->registers[4]);
+	if (event == nullptr)
+		return false;
+
+	event[EventStatusWord] = EventFree;
+	written(cpu, event, EVCB_SIZE);
+
+	finish(cpu, 1, 1);
+	return true;
+}
+
+/* Only the cases that do not block, the BIOS spins otherwise. */
+bool KernelHLE::b0_wait_event(CPU* cpu)
+{
+	uint* event = event_block(cpu, cpu->registers[4]);
+	if (event == nullptr || event[EventStatusWord] == EventBusy)
+		return false;
+
+	uint result = 0;
+	if (event[EventStatusWord] == EventReady) {
+		event[EventStatusWord] = EventBusy;
+		written(cpu, event, EVCB_SIZE);
+		result = 1;
+	}
+
+	finish(cpu, result, 1);
+	return true;
+}
+
+bool KernelHLE::b0_test_event(CPU* cpu)
+{
+	uint* event = event_block(cpu, cpu->registers[4]);
+	if (event == nullptr)
+		return false;
+
+	uint result = 0;
+	if (event[EventStatusWord] == EventReady) {
+		event[EventStatusWord] = EventBusy;
+		written(cpu, event, EVCB_SIZE);
+		result = 1;
+	}
+
+	finish(cpu, result, 1);
+	return true;
+}
+
+bool KernelHLE::b0_enable_event(CPU* cpu)
+{
+	uint* event = event_block(cpu, cpu->registers[4]);
+	if (event == nullptr)
+		return false;
+
+	if (event[EventStatusWord] != EventFree) {
+		event[EventStatusWord] = EventBusy;
+		written(cpu, event, EVCB_SIZE);
+	}
+
+	finish(cpu, 1, 1);
+	return true;
+}
+
+bool KernelHLE::b0_disable_event(CPU* cpu)
+{
+	uint* event = event_block(cpu, cpu->registers[4]);
+	if (event == nullptr)
+		return false;
+
+	if (event[EventStatusWord] != EventFree) {
+		event[EventStatusWord] = EventDisabled;
+		written(cpu, event, EVCB_SIZE);
+	}
+
+	finish(cpu, 1, 1);
+	return true;
+}
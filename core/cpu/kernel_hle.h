@@ -0,0 +1,76 @@
+#pragma once
+#include <cpu/kernel_calls.h>
+#include <cstdio>
+
+/* Rough cost of a native call and of every word it touches, */
+/* so timers keep moving while the BIOS code is skipped. */
+constexpr uint KERNEL_HLE_CALL_CYCLES = 20;
+constexpr uint KERNEL_HLE_WORD_CYCLES = 4;
+
+class CPU;
+class KernelHLE;
+
+using KernelHandler = bool (KernelHLE::*)(CPU*);
+
+/* Implements hot BIOS functions natively against guest RAM. A */
+/* handler returns false to run the BIOS code instead, like for */
+/* pointers outside RAM or events that need a guest callback. */
+/* Each function can be switched off on its own. */
+class KernelHLE {
+public:
+	KernelHLE();
+	~KernelHLE() = default;
+
+	/* Called at the table entry points, before kernel_calls */
+	/* would see the jump back to ra. */
+	inline bool check(CPU* cpu, uint pc);
+
+	bool supported(KernelTable table, uint function);
+
+private:
+	bool call(CPU* cpu, KernelTable table);
+	void finish(CPU* cpu, uint result, uint words);
+	ubyte* guest(CPU* cpu, uint addr, uint size);
+	bool guest_string(CPU* cpu, uint addr, std::string& string);
+	void written(CPU* cpu, void* host, uint size);
+	uint* event_table(CPU* cpu, uint& count);
+	uint* event_block(CPU* cpu, uint event);
+
+	bool a0_memcpy(CPU* cpu);
+	bool a0_memset(CPU* cpu);
+	bool a0_bzero(CPU* cpu);
+	bool a0_strlen(CPU* cpu);
+	bool a0_flush_cache(CPU* cpu);
+	bool a0_printf(CPU* cpu);
+	bool a0_putchar(CPU* cpu);
+	bool a0_puts(CPU* cpu);
+
+	bool b0_deliver_event(CPU* cpu);
+	bool b0_undeliver_event(CPU* cpu);
+	bool b0_open_event(CPU* cpu);
+	bool b0_close_event(CPU* cpu);
+	bool b0_wait_event(CPU* cpu);
+	bool b0_test_event(CPU* cpu);
+	bool b0_enable_event(CPU* cpu);
+	bool b0_disable_event(CPU* cpu);
+
+public:
+	bool enabled = false;
+	bool functions[(uint)KernelTable::Count][256] = {};
+
+	/* Where printf, putchar and puts write to. */
+	std::FILE* sink = stdout;
+	ulong calls = 0;
+
+private:
+	KernelHandler handlers[(uint)KernelTable::Count][256] = {};
+};
+
+inline bool KernelHLE::check(CPU* cpu, uint pc)
+{
+	switch (pc & 0x1fffffff) {
+	case 0xa0: return call(cpu, KernelTable::A0);
+	case 0xb0: return call(cpu, KernelTable::B0);
+	default: return false;
+	}
+}
@@ -1,49 +1,42 @@
 #include <stdafx.hpp>
 #include "cpu.h"
 
-#define BIND_CPU(x) std::bind(&CPU::x, this)
+#define BIND_CPU(x) &CPU::x
 
 void CPU::op_special()
 {
-	auto func = instr.function();
-
-	auto& handler = special[func];
-	if (handler != nullptr)
-		handler();
-	else
-		exception(ExceptionType::IllegalInstr);
+	(this->*special[instr.function()])();
 }
 
 void CPU::op_cop0()
 {
-	switch (instr.rs()) {
-	case 0b00000: op_mfc0(); break;
-	case 0b00100: op_mtc0(); break;
-	case 0b10000: op_rfe(); break;
-	default: exception(ExceptionType::IllegalInstr, instr.id()); break;
-	}
+	(this->*cop0_lookup[instr.rs()])();
 }
 
 void CPU::op_cop2()
 {
-	switch (instr.rs() & 0x10) {
-	case 0x00:
-		switch (instr.rs()) {
-		case 0b00000: op_mfc2(); break;
-		case 0b00010: op_cfc2(); break;
-		case 0b00100: op_mtc2(); break;
-		case 0b00110: op_ctc2(); break;
-		default: exception(ExceptionType::IllegalInstr, instr.id()); break;
-		}
-		break;
-	case 0x10:
-		gte.execute(instr);
-		break;
-	}
+	(this->*cop2_lookup[instr.rs()])();
+}
+
+void CPU::op_gte()
+{
+	cycles += gte.latency[instr.value & 0x3f];
+	gte.execute(instr);
+}
+
+void CPU::op_illegal()
+{
+	exception(ExceptionType::IllegalInstr, instr.id());
 }
 
 void CPU::register_opcodes()
 {
+	/* Unused encodings raise a reserved instruction exception. */
+	std::fill(std::begin(lookup), std::end(lookup), BIND_CPU(op_illegal));
+	std::fill(std::begin(special), std::end(special), BIND_CPU(op_illegal));
+	std::fill(std::begin(cop0_lookup), std::end(cop0_lookup), BIND_CPU(op_illegal));
+	std::fill(std::begin(cop2_lookup), std::end(cop2_lookup), BIND_CPU(op_illegal));
+
 	lookup[0b000000] = BIND_CPU(op_special);
 	lookup[0b000001] = BIND_CPU(op_bcond);
 	lookup[0b001111] = BIND_CPU(op_lui);
@@ -105,4 +98,18 @@ void CPU::register_opcodes()
 	special[0b001101] = BIND_CPU(op_break);
 	special[0b011000] = BIND_CPU(op_mult);
 	special[0b100010] = BIND_CPU(op_sub);
-}
+
+	/* Coprocessor 0 instructions (indexed by the rs field). */
+	cop0_lookup[0b00000] = BIND_CPU(op_mfc0);
+	cop0_lookup[0b00100] = BIND_CPU(op_mtc0);
+	cop0_lookup[0b10000] = BIND_CPU(op_rfe);
+
+	/* Coprocessor 2 instructions (indexed by the rs field). */
+	cop2_lookup[0b00000] = BIND_CPU(op_mfc2);
+	cop2_lookup[0b00010] = BIND_CPU(op_cfc2);
+	cop2_lookup[0b00100] = BIND_CPU(op_mtc2);
+	cop2_lookup[0b00110] = BIND_CPU(op_ctc2);
+
+	/* If bit 4 of rs is set, the instruction is a GTE command. */
+	std::fill(cop2_lookup + 0x10, cop2_lookup + 0x20, BIND_CPU(op_gte));
+}
\ No newline at end of file
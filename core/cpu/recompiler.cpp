@@ -0,0 +1,559 @@
+#include <stdafx.hpp>
+#include "recompiler.h"
+#include "cpu.h"
+
+using Reg = X64Reg;
+using Cond = X64Cond;
+
+/* Argument registers of the host calling convention. */
+#ifdef _WIN32
+constexpr Reg ARG0 = Reg::RCX, ARG1 = Reg::RDX;
+#else
+constexpr Reg ARG0 = Reg::RDI, ARG1 = Reg::RSI;
+#endif
+
+/* Run a single instruction through the interpreter. */
+static void jit_interpret(CPU* cpu, DecodedOp* op)
+{
+	cpu->instr = op->instr;
+	(cpu->*op->handler)();
+
+	cpu->handle_load_delay();
+}
+
+uint CPU::execute_recompiled()
+{
+	/* Misaligned PCs and uncacheable code are interpreted. */
+	uint addr = bus->physical_addr(pc);
+	if ((pc & 0x3) != 0 || !BlockCache::is_cacheable(addr)) {
+		tick();
+		return 1;
+	}
+
+	/* No block is running, free the overwritten ones. */
+	if (!block_cache.retired.empty())
+		block_cache.retired.clear();
+
+	/* The generated code embeds the virtual PC, so */
+	/* a block entered through another segment is rebuilt. */
+	CachedBlock* block = block_cache.find(addr);
+	if (block == nullptr || block->pc != pc)
+		block = compile_block(pc);
+
+	if (block->code == nullptr) {
+		block->code = recompiler.compile(block);
+
+		/* Out of host code space, start over. */
+		if (block->code == nullptr) {
+			flush_cache();
+			block = compile_block(pc);
+			block->code = recompiler.compile(block);
+		}
+	}
+
+	return block->code(this);
+}
+
+Recompiler::Recompiler(CPU* cpu) :
+	cpu(cpu), buffer(JIT_BUFFER_SIZE), emitter(&buffer)
+{
+	auto offset = [cpu](void* member) { return (int)((ubyte*)member - (ubyte*)cpu); };
+
+	registers = offset(&cpu->registers);
+	hi = offset(&cpu->hi);
+	lo = offset(&cpu->lo);
+	current_pc = offset(&cpu->current_pc);
+	pc = offset(&cpu->pc);
+	next_pc = offset(&cpu->next_pc);
+	is_branch = offset(&cpu->is_branch);
+	is_delay_slot = offset(&cpu->is_delay_slot);
+	took_branch = offset(&cpu->took_branch);
+	in_delay_slot_took_branch = offset(&cpu->in_delay_slot_took_branch);
+	load_reg = offset(&cpu->memory_load.reg);
+	load_value = offset(&cpu->memory_load.value);
+	sr = offset(&cpu->cop0.sr);
+	cycles = offset(&cpu->cycles);
+
+	/* Only RAM, BIOS and scratchpad reach the fast path. */
+	for (uint i = 0; i < 128; i++)
+		load_cycles[i] = CPU::read_cycles(i << 22);
+}
+
+void Recompiler::reset()
+{
+	buffer.reset();
+
+	if (cpu->bus->fastmem != nullptr)
+		cpu->bus->fastmem->clear_sites();
+}
+
+X64Mem Recompiler::gpr(uint reg)
+{
+	return X64Mem(Reg::RBX, registers + reg * 4);
+}
+
+X64Mem Recompiler::field(int offset)
+{
+	return X64Mem(Reg::RBX, offset);
+}
+
+/* Check if the instruction writes to memory. */
+static bool is_store(Instr instr)
+{
+	/* SB, SH, SWL, SW, SWR, SWC2. */
+	uint opcode = instr.opcode();
+	return (opcode >= 0b101000 && opcode <= 0b101110) || opcode == 0b111010;
+}
+
+JitFunc Recompiler::compile(CachedBlock* block)
+{
+	auto& e = emitter;
+	auto& ops = block->ops;
+
+	/* Let the caller flush the cache when we run out of space. */
+	if (buffer.remaining() < (ops.size() + 1) * JIT_MAX_OP_SIZE)
+		return nullptr;
+
+	auto entry = (JitFunc)e.current();
+
+	/* Keep the stack aligned and reserve the Win64 shadow space. */
+	e.push(Reg::RBX);
+	e.alu64(X64Alu::SUB, Reg::RSP, 32);
+	e.mov64(Reg::RBX, ARG0);
+
+	this->block = block;
+	pc_dirty = false;
+	flags_dirty = false;
+	load_pending = true;
+	charged = 0;
+	exits.clear();
+	far_code.clear();
+
+	uint count = (uint)ops.size();
+	for (uint i = 0; i < count; i++) {
+		auto& op = ops[i];
+		uint addr = block->pc + i * 4;
+
+		/* The first instruction and delay slots update the PC state */
+		/* from memory, the rest of the block is straight-line code */
+		/* so the PC is known and only written back when needed. */
+		bool delay_slot = i > 0 && BlockCache::is_jump(ops[i - 1].instr);
+		if (i == 0 || delay_slot) {
+			advance();
+		}
+		else {
+			if (flags_dirty) {
+				e.mov8(field(is_delay_slot), (ubyte)0);
+				e.mov8(field(in_delay_slot_took_branch), (ubyte)0);
+				flags_dirty = false;
+			}
+
+			pc_dirty = true;
+		}
+
+		if (!emit_alu(op) && !emit_load(op, addr, i) && !emit_store(op, addr, i))
+			interpret(op, addr, i);
+
+		/* The first instruction may itself be in a delay slot, */
+		/* make sure execution falls through to the next one. */
+		if (i == 0 && count > 1) {
+			charge(1);
+			e.alu(X64Alu::CMP, field(pc), addr + 4);
+			exits.push_back({ e.jcc(Cond::NE), i + 1 });
+
+			/* Later instructions use the known PC. */
+			if (!BlockCache::is_jump(op.instr)) {
+				e.alu(X64Alu::CMP, field(next_pc), addr + 8);
+				exits.push_back({ e.jcc(Cond::NE), i + 1 });
+			}
+		}
+	}
+
+	if (pc_dirty)
+		sync_pc(block->pc + (count - 1) * 4);
+
+	leave(count, charged);
+
+	/* Emit the slow paths and the early exits. Exits are */
+	/* only taken after an instruction that charged itself. */
+	for (auto& code : far_code)
+		code();
+
+	for (auto& [patch, executed] : exits) {
+		e.bind(patch);
+		leave(executed, executed);
+	}
+
+	return entry;
+}
+
+/* Every instruction costs one cycle plus its fetch. Straight */
+/* code is charged in bulk, but anything that can call out to */
+/* the bus charges the block up to itself first, so timers */
+/* read there see the same cycle as in the interpreter. */
+void Recompiler::charge(uint executed)
+{
+	auto& e = emitter;
+
+	if (executed <= charged)
+		return;
+
+	uint op_cycles = 1 + CPU::fetch_cycles(block->pc);
+	e.alu64(X64Alu::ADD, field(cycles), (executed - charged) * op_cycles);
+	charged = executed;
+}
+
+/* Charge the instructions past the first paid ones */
+/* and return the number of executed instructions. */
+void Recompiler::leave(uint executed, uint paid)
+{
+	auto& e = emitter;
+
+	if (executed > paid) {
+		uint op_cycles = 1 + CPU::fetch_cycles(block->pc);
+		e.alu64(X64Alu::ADD, field(cycles), (executed - paid) * op_cycles);
+	}
+
+	e.mov(Reg::RAX, executed);
+	e.alu64(X64Alu::ADD, Reg::RSP, 32);
+	e.pop(Reg::RBX);
+	e.ret();
+}
+
+/* Same as CPU::advance, minus the alignment check */
+/* which was already done when entering the block. */
+void Recompiler::advance()
+{
+	auto& e = emitter;
+
+	e.mov(Reg::RAX, field(pc));
+	e.mov(field(current_pc), Reg::RAX);
+	e.mov(Reg::RAX, field(next_pc));
+	e.mov(field(pc), Reg::RAX);
+	e.alu(X64Alu::ADD, Reg::RAX, 4);
+	e.mov(field(next_pc), Reg::RAX);
+
+	e.mov8(Reg::RAX, field(is_branch));
+	e.mov8(field(is_delay_slot), Reg::RAX);
+	e.mov8(Reg::RAX, field(took_branch));
+	e.mov8(field(in_delay_slot_took_branch), Reg::RAX);
+	e.mov8(field(is_branch), (ubyte)0);
+	e.mov8(field(took_branch), (ubyte)0);
+
+	pc_dirty = false;
+	flags_dirty = true;
+}
+
+/* Write the PC state of the instruction at addr. */
+void Recompiler::sync_pc(uint addr)
+{
+	auto& e = emitter;
+
+	e.mov(field(current_pc), addr);
+	e.mov(field(pc), addr + 4);
+	e.mov(field(next_pc), addr + 8);
+}
+
+/* Apply the pending load of the previous instruction, */
+/* before writing to reg. Mirrors CPU::handle_load_delay. */
+void Recompiler::apply_load(uint reg)
+{
+	auto& e = emitter;
+
+	if (!load_pending)
+		return;
+
+	e.mov(Reg::RDX, field(load_reg));
+	e.alu(X64Alu::CMP, Reg::RDX, reg);
+	auto skip = e.jcc(Cond::E);
+	e.mov(Reg::R8, field(load_value));
+	e.mov(X64Mem(Reg::RBX, Reg::RDX, 4, registers), Reg::R8);
+	e.bind(skip);
+
+	load_pending = false;
+}
+
+/* Write the result in EAX and apply any pending load. */
+void Recompiler::write_reg(uint reg)
+{
+	auto& e = emitter;
+
+	if (load_pending) {
+		/* No load is issued, so the previous one always completes. */
+		apply_load(0);
+		e.mov(field(load_reg), 0u);
+	}
+
+	if (reg != 0)
+		e.mov(gpr(reg), Reg::RAX);
+}
+
+/* Call the interpreter handler of the instruction. */
+void Recompiler::interpret(DecodedOp& op, uint addr, uint index)
+{
+	auto& e = emitter;
+
+	if (pc_dirty)
+		sync_pc(addr);
+
+	charge(index + 1);
+	e.mov64(ARG0, Reg::RBX);
+	e.mov64(ARG1, (ulong)&op);
+	e.call((void*)&jit_interpret);
+
+	/* Leave if an exception was raised. */
+	if (!BlockCache::is_jump(op.instr)) {
+		e.alu(X64Alu::CMP, field(pc), addr + 4);
+		exits.push_back({ e.jcc(Cond::NE), index + 1 });
+	}
+
+	if (is_store(op.instr))
+		check_valid(index);
+
+	pc_dirty = false;
+	load_pending = true;
+}
+
+/* Resume a faulting fastmem access at the */
+/* slow path, which is emitted next. */
+void Recompiler::add_site(ubyte* patch, ubyte* access)
+{
+	auto fastmem = cpu->bus->fastmem.get();
+	if (fastmem != nullptr)
+		fastmem->add_site({ access, patch, emitter.current() });
+}
+
+/* Fallback of the memory instructions. */
+void Recompiler::slow_path(DecodedOp& op, uint addr, uint index, bool dirty)
+{
+	auto& e = emitter;
+
+	if (dirty)
+		sync_pc(addr);
+
+	e.mov64(ARG0, Reg::RBX);
+	e.mov64(ARG1, (ulong)&op);
+	e.call((void*)&jit_interpret);
+
+	e.alu(X64Alu::CMP, field(pc), addr + 4);
+	exits.push_back({ e.jcc(Cond::NE), index + 1 });
+
+	if (is_store(op.instr))
+		check_valid(index);
+}
+
+/* Leave if a store overwrote the code of this block. */
+void Recompiler::check_valid(uint index)
+{
+	auto& e = emitter;
+
+	e.mov64(Reg::RAX, (ulong)&block->valid);
+	e.test8(X64Mem(Reg::RAX), 0xff);
+	exits.push_back({ e.jcc(Cond::E), index + 1 });
+}
+
+/* Compute the host address of a load/store, leaving the */
+/* base in RDX and the offset in RAX. Returns the jumps to */
+/* take for the slow path. */
+std::vector<size_t> Recompiler::translate_addr(Instr instr, uint size, bool write)
+{
+	auto& e = emitter;
+	auto bus = cpu->bus;
+	std::vector<size_t> slow;
+
+	e.mov(Reg::RAX, gpr(instr.rs()));
+	if (instr.imm_s() != 0)
+		e.alu(X64Alu::ADD, Reg::RAX, instr.imm_s());
+
+	/* Isolated cache. */
+	e.test8(X64Mem(Reg::RBX, sr + 2), 0x1);
+	slow.push_back(e.jcc(Cond::NE));
+
+	/* Alignment errors. */
+	if (size > 1) {
+		e.test(Reg::RAX, size - 1);
+		slow.push_back(e.jcc(Cond::NE));
+	}
+
+	/* Remember the region of loads to charge their cost. */
+	if (!write) {
+		e.mov(Reg::R9, Reg::RAX);
+		e.alu(X64Alu::AND, Reg::R9, 0x1fffffff);
+		e.shift(X64Shift::SHR, Reg::R9, 22);
+	}
+
+	/* Fastmem: MMIO and code pages fault instead. */
+	if (bus->fastmem != nullptr) {
+		e.mov(Reg::RCX, Reg::RAX);
+		e.shift(X64Shift::SHR, Reg::RCX, 29);
+		e.mov64(Reg::RDX, (ulong)bus->region_mask);
+		e.alu(X64Alu::AND, Reg::RAX, X64Mem(Reg::RDX, Reg::RCX, 4));
+		e.mov64(Reg::RDX, (ulong)bus->fastmem->base);
+		return slow;
+	}
+
+	/* Null pages are MMIO or hold code. */
+	auto& table = write ? bus->write_table : bus->read_table;
+	e.mov(Reg::RCX, Reg::RAX);
+	e.shift(X64Shift::SHR, Reg::RCX, MEM_PAGE_SHIFT);
+	e.mov64(Reg::RDX, (ulong)table.data());
+	e.mov64(Reg::RDX, X64Mem(Reg::RDX, Reg::RCX, 8));
+	e.test64(Reg::RDX, Reg::RDX);
+	slow.push_back(e.jcc(Cond::E));
+	e.alu(X64Alu::AND, Reg::RAX, MEM_PAGE_MASK);
+
+	return slow;
+}
+
+static void emit_read(X64Emitter& e, CPUfunc handler, X64Mem src)
+{
+	if (handler == &CPU::op_lw) e.mov(Reg::RCX, src);
+	else if (handler == &CPU::op_lh) e.movsx16(Reg::RCX, src);
+	else if (handler == &CPU::op_lhu) e.movzx16(Reg::RCX, src);
+	else if (handler == &CPU::op_lb) e.movsx8(Reg::RCX, src);
+	else e.movzx8(Reg::RCX, src);
+}
+
+static void emit_write(X64Emitter& e, uint size, X64Mem dst)
+{
+	if (size == 4) e.mov(dst, Reg::RCX);
+	else if (size == 2) e.mov16(dst, Reg::RCX);
+	else e.mov8(dst, Reg::RCX);
+}
+
+bool Recompiler::emit_alu(DecodedOp& op)
+{
+	auto& e = emitter;
+	auto handler = op.handler;
+	auto instr = op.instr;
+
+	auto rs = gpr(instr.rs());
+	auto rt = gpr(instr.rt());
+	auto alu_reg = [&](X64Alu alu) { e.mov(Reg::RAX, rs); e.alu(alu, Reg::RAX, rt); };
+	auto alu_imm = [&](X64Alu alu, uint imm) { e.mov(Reg::RAX, rs); e.alu(alu, Reg::RAX, imm); };
+	auto compare = [&](Cond cond) { e.setcc(cond, Reg::RAX); e.movzx8(Reg::RAX, Reg::RAX); };
+	auto shift_imm = [&](X64Shift shift) { e.mov(Reg::RAX, rt); e.shift(shift, Reg::RAX, instr.sa()); };
+	auto shift_var = [&](X64Shift shift) { e.mov(Reg::RCX, rs); e.mov(Reg::RAX, rt); e.shift_cl(shift, Reg::RAX); };
+
+	/* R-Type. */
+	if (handler == &CPU::op_addu) alu_reg(X64Alu::ADD);
+	else if (handler == &CPU::op_subu) alu_reg(X64Alu::SUB);
+	else if (handler == &CPU::op_and) alu_reg(X64Alu::AND);
+	else if (handler == &CPU::op_or) alu_reg(X64Alu::OR);
+	else if (handler == &CPU::op_xor) alu_reg(X64Alu::XOR);
+	else if (handler == &CPU::op_nor) { alu_reg(X64Alu::OR); e.not_(Reg::RAX); }
+	else if (handler == &CPU::op_slt) { alu_reg(X64Alu::CMP); compare(Cond::L); }
+	else if (handler == &CPU::op_sltu) { alu_reg(X64Alu::CMP); compare(Cond::B); }
+	else if (handler == &CPU::op_sll) shift_imm(X64Shift::SHL);
+	else if (handler == &CPU::op_srl) shift_imm(X64Shift::SHR);
+	else if (handler == &CPU::op_sra) shift_imm(X64Shift::SAR);
+	else if (handler == &CPU::op_sllv) shift_var(X64Shift::SHL);
+	else if (handler == &CPU::op_srlv) shift_var(X64Shift::SHR);
+	else if (handler == &CPU::op_srav) shift_var(X64Shift::SAR);
+	else if (handler == &CPU::op_mfhi) e.mov(Reg::RAX, field(hi));
+	else if (handler == &CPU::op_mflo) e.mov(Reg::RAX, field(lo));
+	else if (handler == &CPU::op_mthi || handler == &CPU::op_mtlo) {
+		/* These do not write a GPR. */
+		e.mov(Reg::RAX, rs);
+		e.mov(field(handler == &CPU::op_mthi ? hi : lo), Reg::RAX);
+		write_reg(0);
+		return true;
+	}
+	/* I-Type. */
+	else if (handler == &CPU::op_addiu) alu_imm(X64Alu::ADD, instr.imm_s());
+	else if (handler == &CPU::op_andi) alu_imm(X64Alu::AND, instr.imm());
+	else if (handler == &CPU::op_ori) alu_imm(X64Alu::OR, instr.imm());
+	else if (handler == &CPU::op_xori) alu_imm(X64Alu::XOR, instr.imm());
+	else if (handler == &CPU::op_slti) { alu_imm(X64Alu::CMP, instr.imm_s()); compare(Cond::L); }
+	else if (handler == &CPU::op_sltiu) { alu_imm(X64Alu::CMP, instr.imm_s()); compare(Cond::B); }
+	else if (handler == &CPU::op_lui) e.mov(Reg::RAX, instr.imm() << 16);
+	else return false;
+
+	bool itype = instr.opcode() != 0;
+	write_reg(itype ? instr.rt() : instr.rd());
+
+	return true;
+}
+
+bool Recompiler::emit_load(DecodedOp& op, uint addr, uint index)
+{
+	auto& e = emitter;
+	auto handler = op.handler;
+	auto instr = op.instr;
+
+	uint size;
+	if (handler == &CPU::op_lw) size = 4;
+	else if (handler == &CPU::op_lh || handler == &CPU::op_lhu) size = 2;
+	else if (handler == &CPU::op_lb || handler == &CPU::op_lbu) size = 1;
+	else return false;
+
+	charge(index + 1);
+	ubyte* patch = e.current();
+	auto slow = translate_addr(instr, size, false);
+	ubyte* access = e.current();
+	emit_read(e, handler, X64Mem(Reg::RDX, Reg::RAX, 1));
+
+	e.mov64(Reg::RDX, (ulong)load_cycles);
+	e.movzx8(Reg::RDX, X64Mem(Reg::RDX, Reg::R9, 1));
+	e.alu64(X64Alu::ADD, field(cycles), Reg::RDX);
+
+	/* Issue the load, the value is in ECX. */
+	uint rt = instr.rt();
+	if (load_pending) {
+		apply_load(rt);
+		e.mov(gpr(0), 0u);
+	}
+
+	e.mov(field(load_reg), rt);
+	e.mov(field(load_value), Reg::RCX);
+	load_pending = rt != 0;
+
+	ubyte* join = e.current();
+
+	bool dirty = pc_dirty;
+	far_code.push_back([=, this, &op, &e]() {
+		add_site(patch, access);
+		for (auto jump : slow)
+			e.bind(jump);
+
+		slow_path(op, addr, index, dirty);
+		e.jmp(join);
+	});
+
+	return true;
+}
+
+bool Recompiler::emit_store(DecodedOp& op, uint addr, uint index)
+{
+	auto& e = emitter;
+	auto handler = op.handler;
+	auto instr = op.instr;
+
+	uint size;
+	if (handler == &CPU::op_sw) size = 4;
+	else if (handler == &CPU::op_sh) size = 2;
+	else if (handler == &CPU::op_sb) size = 1;
+	else return false;
+
+	charge(index + 1);
+	ubyte* patch = e.current();
+	auto slow = translate_addr(instr, size, true);
+	e.mov(Reg::RCX, gpr(instr.rt()));
+	ubyte* access = e.current();
+	emit_write(e, size, X64Mem(Reg::RDX, Reg::RAX, 1));
+
+	write_reg(0);
+	ubyte* join = e.current();
+
+	bool dirty = pc_dirty;
+	far_code.push_back([=, this, &op, &e]() {
+		add_site(patch, access);
+		for (auto jump : slow)
+			e.bind(jump);
+
+		slow_path(op, addr, index, dirty);
+		e.jmp(join);
+	});
+
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cpu/block_cache.h>
+#include <cpu/x64_emitter.h>
+
+/* Size of the host code buffer. */
+constexpr size_t JIT_BUFFER_SIZE = 32 * 1024 * 1024;
+
+/* Upper bound of host code emitted per instruction. */
+constexpr size_t JIT_MAX_OP_SIZE = 512;
+
+/* Translates cached blocks to x86-64 host code. */
+/* The CPU object is used as the guest context: RBX holds */
+/* its address and every register, hi/lo and the PC state */
+/* are accessed relative to it. */
+class Recompiler {
+public:
+	Recompiler(CPU* cpu);
+	~Recompiler() = default;
+
+	JitFunc compile(CachedBlock* block);
+	void reset();
+
+private:
+	/* Guest state updates. */
+	void advance();
+	void sync_pc(uint addr);
+	void apply_load(uint reg);
+	void write_reg(uint reg);
+	void charge(uint executed);
+	void leave(uint executed, uint paid);
+
+	/* Instruction translation. */
+	void interpret(DecodedOp& op, uint addr, uint index);
+	void slow_path(DecodedOp& op, uint addr, uint index, bool dirty);
+	void check_valid(uint index);
+	void add_site(ubyte* patch, ubyte* access);
+	std::vector<size_t> translate_addr(Instr instr, uint size, bool write);
+	bool emit_alu(DecodedOp& op);
+	bool emit_load(DecodedOp& op, uint addr, uint index);
+	bool emit_store(DecodedOp& op, uint addr, uint index);
+
+	X64Mem gpr(uint reg);
+	X64Mem field(int offset);
+
+public:
+	CPU* cpu;
+	CodeBuffer buffer;
+	X64Emitter emitter;
+
+	/* Offsets of the guest state inside the CPU. */
+	int registers, hi, lo;
+	int current_pc, pc, next_pc;
+	int is_branch, is_delay_slot;
+	int took_branch, in_delay_slot_took_branch;
+	int load_reg, load_value, sr;
+	int cycles;
+
+	/* Cost of a fast path load, by (addr & 0x1fffffff) >> 22. */
+	ubyte load_cycles[128];
+
+	/* Block being translated. */
+	CachedBlock* block = nullptr;
+
+	/* What the block knows about the guest state */
+	/* at the current point of translation. */
+	bool pc_dirty = false, flags_dirty = false;
+	bool load_pending = true;
+
+	/* Instructions whose base cost is already in cycles. */
+	uint charged = 0;
+
+	/* Code placed after the block body. */
+	std::vector<std::pair<size_t, uint>> exits;
+	std::vector<std::function<void()>> far_code;
+};
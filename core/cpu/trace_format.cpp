@@ -0,0 +1,132 @@
+#include <stdafx.hpp>
+#include "trace_format.h"
+
+/* Record flags, the fields they guard follow the */
+/* instruction word in this order. */
+enum TraceFlags : ubyte {
+	TRACE_JUMP = 1 << 0,	/* PC is not the previous PC + 4 */
+	TRACE_REG = 1 << 1,		/* A register changed */
+	TRACE_ACCESS = 1 << 2	/* The instruction accessed memory */
+};
+
+static void put_varint(std::vector<ubyte>& out, uint value)
+{
+	while (value >= 0x80) {
+		out.push_back((ubyte)(value | 0x80));
+		value >>= 7;
+	}
+
+	out.push_back((ubyte)value);
+}
+
+/* Small negative deltas are zigzag encoded to stay short. */
+static void put_delta(std::vector<ubyte>& out, uint delta)
+{
+	uint sign = (uint)((int)delta >> 31);
+	put_varint(out, (delta << 1) ^ sign);
+}
+
+static bool get_varint(const ubyte*& data, const ubyte* end, uint& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (data == end)
+			return false;
+
+		ubyte byte = *data++;
+		value |= (uint)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static bool get_delta(const ubyte*& data, const ubyte* end, uint& delta)
+{
+	uint value;
+	if (!get_varint(data, end, value))
+		return false;
+
+	delta = (value >> 1) ^ (0 - (value & 1));
+	return true;
+}
+
+void encode_trace_block(const TraceRecord* records, uint count, std::vector<ubyte>& out)
+{
+	uint next_pc = 0, prev_addr = 0;
+
+	for (uint i = 0; i < count; i++) {
+		auto& record = records[i];
+
+		ubyte flags = 0;
+		if (record.pc != next_pc) flags |= TRACE_JUMP;
+		if (record.reg != 0) flags |= TRACE_REG;
+		if (record.access) flags |= TRACE_ACCESS;
+
+		out.push_back(flags);
+		for (int shift = 0; shift < 32; shift += 8)
+			out.push_back((ubyte)(record.instr >> shift));
+
+		if (flags & TRACE_JUMP)
+			put_delta(out, record.pc - next_pc);
+
+		if (flags & TRACE_REG) {
+			out.push_back(record.reg);
+			put_varint(out, record.value);
+		}
+
+		if (flags & TRACE_ACCESS) {
+			put_delta(out, record.addr - prev_addr);
+			prev_addr = record.addr;
+		}
+
+		next_pc = record.pc + 4;
+	}
+}
+
+bool decode_trace_block(const ubyte* data, uint size, uint count, std::vector<TraceRecord>& out)
+{
+	const ubyte* end = data + size;
+	uint next_pc = 0, prev_addr = 0;
+
+	for (uint i = 0; i < count; i++) {
+		if (end - data < 5)
+			return false;
+
+		TraceRecord record = {};
+		ubyte flags = *data++;
+
+		for (int shift = 0; shift < 32; shift += 8)
+			record.instr |= (uint)(*data++) << shift;
+
+		uint delta = 0;
+		if ((flags & TRACE_JUMP) && !get_delta(data, end, delta))
+			return false;
+
+		record.pc = next_pc + delta;
+
+		if (flags & TRACE_REG) {
+			if (data == end)
+				return false;
+
+			record.reg = *data++;
+			if (!get_varint(data, end, record.value))
+				return false;
+		}
+
+		if (flags & TRACE_ACCESS) {
+			if (!get_delta(data, end, delta))
+				return false;
+
+			record.access = true;
+			record.addr = prev_addr + delta;
+			prev_addr = record.addr;
+		}
+
+		next_pc = record.pc + 4;
+		out.push_back(record);
+	}
+
+	return data == end;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <utility/types.hpp>
+#include <vector>
+
+/* File layout: a TraceHeader followed by blocks. Each block is */
+/* a TraceBlockHeader and the encoding of its records. Every */
+/* block but the last holds exactly block_records records and */
+/* is encoded from scratch, so two identical runs produce */
+/* byte-identical blocks that can be compared without decoding. */
+constexpr uint TRACE_MAGIC = 0x54585350; /* "PSXT" */
+constexpr uint TRACE_VERSION = 1;
+constexpr uint TRACE_BLOCK_RECORDS = 4096;
+
+/* One executed instruction. reg is the register it changed */
+/* (0 for none), access is set for loads and stores. */
+struct TraceRecord {
+	uint pc;
+	uint instr;
+	uint value;
+	uint addr;
+	ubyte reg;
+	bool access;
+
+	bool operator==(const TraceRecord& other) const
+	{
+		return pc == other.pc && instr == other.instr && reg == other.reg &&
+			(reg == 0 || value == other.value) && access == other.access &&
+			(!access || addr == other.addr);
+	}
+};
+
+struct TraceHeader {
+	uint magic;
+	uint version;
+	uint block_records;
+	uint reserved;
+};
+
+struct TraceBlockHeader {
+	uint records;
+	uint size;
+};
+
+/* Append the encoding of count records to out. */
+void encode_trace_block(const TraceRecord* records, uint count, std::vector<ubyte>& out);
+
+/* Decode a block, returns false if it is malformed. */
+bool decode_trace_block(const ubyte* data, uint size, uint count, std::vector<TraceRecord>& out);
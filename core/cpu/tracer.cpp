@@ -0,0 +1,88 @@
+#include <stdafx.hpp>
+#include "tracer.h"
+
+Tracer::Tracer()
+{
+	ring.resize(TRACE_RING_SIZE);
+}
+
+Tracer::~Tracer()
+{
+	close();
+}
+
+bool Tracer::open(const std::string& path)
+{
+	close();
+
+	file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	TraceHeader header = { TRACE_MAGIC, TRACE_VERSION, TRACE_BLOCK_RECORDS, 0 };
+	std::fwrite(&header, sizeof(header), 1, file);
+
+	head = 0;
+	tail = 0;
+	running = true;
+	writer = std::thread(&Tracer::writer_loop, this);
+
+	return true;
+}
+
+/* Stop the writer after it flushed every record. */
+void Tracer::close()
+{
+	if (file == nullptr)
+		return;
+
+	running = false;
+	writer.join();
+
+	std::fclose(file);
+	file = nullptr;
+}
+
+void Tracer::writer_loop()
+{
+	while (true) {
+		/* Read the flag first so the last records */
+		/* are not missed when the tracer is closed. */
+		bool stop = !running.load(std::memory_order_acquire);
+
+		size_t start = tail.load(std::memory_order_relaxed);
+		size_t end = head.load(std::memory_order_acquire);
+
+		/* Only whole blocks are written until the end. */
+		if (end - start >= TRACE_BLOCK_RECORDS) {
+			write_block(start, TRACE_BLOCK_RECORDS);
+		}
+		else if (stop) {
+			if (end != start)
+				write_block(start, (uint)(end - start));
+			break;
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	std::fflush(file);
+}
+
+void Tracer::write_block(size_t start, uint count)
+{
+	/* Copy the records out so the ring can be refilled. */
+	block.clear();
+	for (uint i = 0; i < count; i++)
+		block.push_back(ring[(start + i) & (TRACE_RING_SIZE - 1)]);
+
+	tail.store(start + count, std::memory_order_release);
+
+	encoded.clear();
+	encode_trace_block(block.data(), count, encoded);
+
+	TraceBlockHeader header = { count, (uint)encoded.size() };
+	std::fwrite(&header, sizeof(header), 1, file);
+	std::fwrite(encoded.data(), 1, encoded.size(), file);
+}
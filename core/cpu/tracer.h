@@ -0,0 +1,53 @@
+#pragma once
+#include <cpu/trace_format.h>
+#include <atomic>
+#include <thread>
+
+/* Number of records the ring buffer holds, a power of two. */
+constexpr size_t TRACE_RING_SIZE = 1 << 16;
+
+/* Collects trace records in a preallocated ring buffer that */
+/* a writer thread compresses and writes to disk in blocks. */
+/* The CPU thread is the only producer and only waits when */
+/* the writer falls a full ring behind, so no record is ever */
+/* dropped. */
+class Tracer {
+public:
+	Tracer();
+	~Tracer();
+
+	bool open(const std::string& path);
+	void close();
+	bool is_open() const { return file != nullptr; }
+
+	inline void record(const TraceRecord& entry)
+	{
+		size_t index = head.load(std::memory_order_relaxed);
+		while (index - tail.load(std::memory_order_acquire) == TRACE_RING_SIZE)
+			std::this_thread::yield();
+
+		ring[index & (TRACE_RING_SIZE - 1)] = entry;
+		head.store(index + 1, std::memory_order_release);
+	}
+
+private:
+	void writer_loop();
+	void write_block(size_t start, uint count);
+
+public:
+	/* Include the register each instruction changed */
+	/* and the address of loads and stores. */
+	bool registers = true;
+	bool accesses = true;
+
+private:
+	std::FILE* file = nullptr;
+	std::vector<TraceRecord> ring;
+	std::atomic<size_t> head{ 0 }, tail{ 0 };
+	std::atomic<bool> running{ false };
+	std::thread writer;
+
+	/* Owned by the writer thread. */
+	std::vector<TraceRecord> block;
+	std::vector<ubyte> encoded;
+};
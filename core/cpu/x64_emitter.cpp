@@ -0,0 +1,344 @@
+#include <stdafx.hpp>
+#include "x64_emitter.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+CodeBuffer::CodeBuffer(size_t size)
+{
+#ifdef _WIN32
+	void* ptr = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) ptr = nullptr;
+#endif
+
+	if (ptr == nullptr)
+		throw std::runtime_error("[JIT] Could not allocate executable memory!");
+
+	memory = (ubyte*)ptr;
+	capacity = size;
+}
+
+CodeBuffer::~CodeBuffer()
+{
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, capacity);
+#endif
+}
+
+X64Emitter::X64Emitter(CodeBuffer* buffer) :
+	buffer(buffer)
+{
+}
+
+void X64Emitter::emit8(ubyte value)
+{
+	buffer->memory[buffer->offset++] = value;
+}
+
+void X64Emitter::emit32(uint value)
+{
+	std::memcpy(buffer->current(), &value, sizeof(uint));
+	buffer->offset += sizeof(uint);
+}
+
+void X64Emitter::emit64(ulong value)
+{
+	std::memcpy(buffer->current(), &value, sizeof(ulong));
+	buffer->offset += sizeof(ulong);
+}
+
+void X64Emitter::rex(bool w, uint reg, uint index, uint base, bool force)
+{
+	ubyte prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+	if (prefix != 0x40 || force)
+		emit8(prefix);
+}
+
+/* Encode the ModRM, SIB and displacement bytes. */
+void X64Emitter::modrm(uint reg, const X64Mem& mem)
+{
+	uint base = (uint)mem.base & 7;
+	bool has_sib = mem.index != X64Reg::NONE || base == 4;
+
+	/* RBP/R13 cannot be encoded without a displacement. */
+	uint mod = 2;
+	if (mem.disp == 0 && base != 5)
+		mod = 0;
+	else if (mem.disp >= -128 && mem.disp <= 127)
+		mod = 1;
+
+	emit8((mod << 6) | ((reg & 7) << 3) | (has_sib ? 4 : base));
+	if (has_sib) {
+		uint scale = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+		uint index = mem.index == X64Reg::NONE ? 4 : (uint)mem.index & 7;
+		emit8((scale << 6) | (index << 3) | base);
+	}
+
+	if (mod == 1)
+		emit8((ubyte)mem.disp);
+	else if (mod == 2)
+		emit32((uint)mem.disp);
+}
+
+void X64Emitter::op_mem(std::initializer_list<ubyte> opcode, uint reg, const X64Mem& mem, bool w, bool force_rex)
+{
+	uint index = mem.index == X64Reg::NONE ? 0 : (uint)mem.index;
+	rex(w, reg, index, (uint)mem.base, force_rex);
+
+	for (auto byte : opcode)
+		emit8(byte);
+
+	modrm(reg, mem);
+}
+
+void X64Emitter::op_reg(std::initializer_list<ubyte> opcode, uint reg, X64Reg rm, bool w)
+{
+	rex(w, reg, 0, (uint)rm);
+
+	for (auto byte : opcode)
+		emit8(byte);
+
+	emit8(0xC0 | ((reg & 7) << 3) | ((uint)rm & 7));
+}
+
+void X64Emitter::mov(X64Reg dst, X64Reg src)
+{
+	op_reg({ 0x89 }, (uint)src, dst);
+}
+
+void X64Emitter::mov(X64Reg dst, uint imm)
+{
+	rex(false, 0, 0, (uint)dst);
+	emit8(0xB8 + ((uint)dst & 7));
+	emit32(imm);
+}
+
+void X64Emitter::mov(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x8B }, (uint)dst, src);
+}
+
+void X64Emitter::mov(X64Mem dst, X64Reg src)
+{
+	op_mem({ 0x89 }, (uint)src, dst);
+}
+
+void X64Emitter::mov(X64Mem dst, uint imm)
+{
+	op_mem({ 0xC7 }, 0, dst);
+	emit32(imm);
+}
+
+void X64Emitter::mov8(X64Reg dst, X64Mem src)
+{
+	/* SPL, BPL, SIL and DIL need an empty REX prefix. */
+	op_mem({ 0x8A }, (uint)dst, src, false, (uint)dst >= 4);
+}
+
+void X64Emitter::mov8(X64Mem dst, X64Reg src)
+{
+	op_mem({ 0x88 }, (uint)src, dst, false, (uint)src >= 4);
+}
+
+void X64Emitter::mov8(X64Mem dst, ubyte imm)
+{
+	op_mem({ 0xC6 }, 0, dst);
+	emit8(imm);
+}
+
+void X64Emitter::mov16(X64Mem dst, X64Reg src)
+{
+	emit8(0x66);
+	op_mem({ 0x89 }, (uint)src, dst);
+}
+
+void X64Emitter::mov64(X64Reg dst, X64Reg src)
+{
+	op_reg({ 0x89 }, (uint)src, dst, true);
+}
+
+void X64Emitter::mov64(X64Reg dst, ulong imm)
+{
+	rex(true, 0, 0, (uint)dst);
+	emit8(0xB8 + ((uint)dst & 7));
+	emit64(imm);
+}
+
+void X64Emitter::mov64(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x8B }, (uint)dst, src, true);
+}
+
+void X64Emitter::movzx8(X64Reg dst, X64Reg src)
+{
+	rex(false, (uint)dst, 0, (uint)src, (uint)src >= 4);
+	emit8(0x0F); emit8(0xB6);
+	emit8(0xC0 | (((uint)dst & 7) << 3) | ((uint)src & 7));
+}
+
+void X64Emitter::movzx8(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x0F, 0xB6 }, (uint)dst, src);
+}
+
+void X64Emitter::movzx16(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x0F, 0xB7 }, (uint)dst, src);
+}
+
+void X64Emitter::movsx8(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x0F, 0xBE }, (uint)dst, src);
+}
+
+void X64Emitter::movsx16(X64Reg dst, X64Mem src)
+{
+	op_mem({ 0x0F, 0xBF }, (uint)dst, src);
+}
+
+void X64Emitter::alu(X64Alu op, X64Reg dst, X64Reg src)
+{
+	op_reg({ (ubyte)(((uint)op << 3) | 0x1) }, (uint)src, dst);
+}
+
+void X64Emitter::alu(X64Alu op, X64Reg dst, X64Mem src)
+{
+	op_mem({ (ubyte)(((uint)op << 3) | 0x3) }, (uint)dst, src);
+}
+
+void X64Emitter::alu(X64Alu op, X64Reg dst, uint imm)
+{
+	/* Use the sign extended imm8 form when possible. */
+	if ((int)imm >= -128 && (int)imm <= 127) {
+		op_reg({ 0x83 }, (uint)op, dst);
+		emit8((ubyte)imm);
+	}
+	else {
+		op_reg({ 0x81 }, (uint)op, dst);
+		emit32(imm);
+	}
+}
+
+void X64Emitter::alu(X64Alu op, X64Mem dst, uint imm)
+{
+	op_mem({ 0x81 }, (uint)op, dst);
+	emit32(imm);
+}
+
+void X64Emitter::alu64(X64Alu op, X64Reg dst, uint imm)
+{
+	op_reg({ 0x81 }, (uint)op, dst, true);
+	emit32(imm);
+}
+
+void X64Emitter::alu64(X64Alu op, X64Mem dst, uint imm)
+{
+	op_mem({ 0x81 }, (uint)op, dst, true);
+	emit32(imm);
+}
+
+void X64Emitter::alu64(X64Alu op, X64Mem dst, X64Reg src)
+{
+	op_mem({ (ubyte)(((uint)op << 3) | 0x1) }, (uint)src, dst, true);
+}
+
+void X64Emitter::shift(X64Shift op, X64Reg dst, ubyte imm)
+{
+	op_reg({ 0xC1 }, (uint)op, dst);
+	emit8(imm);
+}
+
+void X64Emitter::shift_cl(X64Shift op, X64Reg dst)
+{
+	op_reg({ 0xD3 }, (uint)op, dst);
+}
+
+void X64Emitter::not_(X64Reg dst)
+{
+	op_reg({ 0xF7 }, 2, dst);
+}
+
+void X64Emitter::test(X64Reg dst, uint imm)
+{
+	op_reg({ 0xF7 }, 0, dst);
+	emit32(imm);
+}
+
+void X64Emitter::test64(X64Reg dst, X64Reg src)
+{
+	op_reg({ 0x85 }, (uint)src, dst, true);
+}
+
+void X64Emitter::test8(X64Mem dst, ubyte imm)
+{
+	op_mem({ 0xF6 }, 0, dst);
+	emit8(imm);
+}
+
+void X64Emitter::setcc(X64Cond cond, X64Reg dst)
+{
+	rex(false, 0, 0, (uint)dst, (uint)dst >= 4);
+	emit8(0x0F); emit8(0x90 + (uint)cond);
+	emit8(0xC0 | ((uint)dst & 7));
+}
+
+size_t X64Emitter::jcc(X64Cond cond)
+{
+	emit8(0x0F); emit8(0x80 + (uint)cond);
+	emit32(0);
+
+	return buffer->offset - 4;
+}
+
+size_t X64Emitter::jmp()
+{
+	emit8(0xE9);
+	emit32(0);
+
+	return buffer->offset - 4;
+}
+
+void X64Emitter::jmp(ubyte* target)
+{
+	emit8(0xE9);
+	emit32((uint)(target - (current() + 4)));
+}
+
+/* Point a forward jump to the current location. */
+void X64Emitter::bind(size_t patch)
+{
+	uint rel = (uint)(buffer->offset - (patch + 4));
+	std::memcpy(buffer->memory + patch, &rel, sizeof(uint));
+}
+
+void X64Emitter::call(const void* function)
+{
+	/* call rax */
+	mov64(X64Reg::RAX, (ulong)function);
+	emit8(0xFF); emit8(0xD0);
+}
+
+void X64Emitter::push(X64Reg reg)
+{
+	rex(false, 0, 0, (uint)reg);
+	emit8(0x50 + ((uint)reg & 7));
+}
+
+void X64Emitter::pop(X64Reg reg)
+{
+	rex(false, 0, 0, (uint)reg);
+	emit8(0x58 + ((uint)reg & 7));
+}
+
+void X64Emitter::ret()
+{
+	emit8(0xC3);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+/* x86-64 general purpose registers. */
+enum class X64Reg : ubyte {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+	NONE = 0xff
+};
+
+/* Condition codes of Jcc/SETcc. */
+enum class X64Cond : ubyte {
+	O, NO, B, AE, E, NE, BE, A,
+	S, NS, P, NP, L, GE, LE, G
+};
+
+/* Group 1 arithmetic operations (the /r extension). */
+enum class X64Alu : ubyte {
+	ADD = 0, OR = 1, AND = 4,
+	SUB = 5, XOR = 6, CMP = 7
+};
+
+/* Group 2 shift operations (the /r extension). */
+enum class X64Shift : ubyte {
+	SHL = 4, SHR = 5, SAR = 7
+};
+
+/* Memory operand of the form [base + index * scale + disp]. */
+struct X64Mem {
+	X64Mem(X64Reg base, int disp = 0) :
+		base(base), disp(disp) {}
+	X64Mem(X64Reg base, X64Reg index, ubyte scale, int disp = 0) :
+		base(base), index(index), scale(scale), disp(disp) {}
+
+public:
+	X64Reg base;
+	X64Reg index = X64Reg::NONE;
+	ubyte scale = 1;
+	int disp = 0;
+};
+
+/* A block of memory the host is allowed to execute. */
+class CodeBuffer {
+public:
+	CodeBuffer(size_t size);
+	~CodeBuffer();
+
+	ubyte* current() { return memory + offset; }
+	size_t remaining() { return capacity - offset; }
+	void reset() { offset = 0; }
+
+public:
+	ubyte* memory = nullptr;
+	size_t capacity = 0, offset = 0;
+};
+
+/* A minimal x86-64 assembler. Only the encodings needed */
+/* by the recompiler are provided, all of them operate */
+/* on 32bit registers unless the name says otherwise. */
+class X64Emitter {
+public:
+	X64Emitter(CodeBuffer* buffer);
+	~X64Emitter() = default;
+
+	/* Data movement. */
+	void mov(X64Reg dst, X64Reg src);
+	void mov(X64Reg dst, uint imm);
+	void mov(X64Reg dst, X64Mem src);
+	void mov(X64Mem dst, X64Reg src);
+	void mov(X64Mem dst, uint imm);
+	void mov8(X64Reg dst, X64Mem src);
+	void mov8(X64Mem dst, X64Reg src);
+	void mov8(X64Mem dst, ubyte imm);
+	void mov16(X64Mem dst, X64Reg src);
+	void mov64(X64Reg dst, X64Reg src);
+	void mov64(X64Reg dst, ulong imm);
+	void mov64(X64Reg dst, X64Mem src);
+	void movzx8(X64Reg dst, X64Reg src);
+	void movzx8(X64Reg dst, X64Mem src);
+	void movzx16(X64Reg dst, X64Mem src);
+	void movsx8(X64Reg dst, X64Mem src);
+	void movsx16(X64Reg dst, X64Mem src);
+
+	/* Arithmetic. */
+	void alu(X64Alu op, X64Reg dst, X64Reg src);
+	void alu(X64Alu op, X64Reg dst, X64Mem src);
+	void alu(X64Alu op, X64Reg dst, uint imm);
+	void alu(X64Alu op, X64Mem dst, uint imm);
+	void alu64(X64Alu op, X64Reg dst, uint imm);
+	void alu64(X64Alu op, X64Mem dst, uint imm);
+	void alu64(X64Alu op, X64Mem dst, X64Reg src);
+	void shift(X64Shift op, X64Reg dst, ubyte imm);
+	void shift_cl(X64Shift op, X64Reg dst);
+	void not_(X64Reg dst);
+	void test(X64Reg dst, uint imm);
+	void test64(X64Reg dst, X64Reg src);
+	void test8(X64Mem dst, ubyte imm);
+	void setcc(X64Cond cond, X64Reg dst);
+
+	/* Control flow. Forward jumps return the offset */
+	/* of their displacement, resolved with bind. */
+	size_t jcc(X64Cond cond);
+	size_t jmp();
+	void jmp(ubyte* target);
+	void bind(size_t patch);
+	void call(const void* function);
+	void push(X64Reg reg);
+	void pop(X64Reg reg);
+	void ret();
+
+	ubyte* current() { return buffer->current(); }
+
+private:
+	void emit8(ubyte value);
+	void emit32(uint value);
+	void emit64(ulong value);
+	void rex(bool w, uint reg, uint index, uint base, bool force = false);
+	void modrm(uint reg, const X64Mem& mem);
+	void op_mem(std::initializer_list<ubyte> opcode, uint reg, const X64Mem& mem, bool w = false, bool force_rex = false);
+	void op_reg(std::initializer_list<ubyte> opcode, uint reg, X64Reg rm, bool w = false);
+
+public:
+	CodeBuffer* buffer;
+};
@@ -145,3 +145,93 @@ bool CDDisk::is_empty()
 {
     return tracks.empty();
 }
+
+/* Read the user data of a sector, lba counts from the start of the image. */
+bool CDDisk::read_data(uint lba, ubyte* data)
+{
+    if (tracks.empty() || lba >= tracks[0].frame_count)
+        return false;
+
+    ubyte sector[SECTOR_SIZE];
+    auto& file = tracks[0].file;
+
+    file.clear();
+    file.seekg((std::streamoff)lba * SECTOR_SIZE);
+    if (!file.read((char*)sector, SECTOR_SIZE))
+        return false;
+
+    /* Mode 2 sectors have an 8 byte subheader after the header. */
+    uint offset = (sector[15] == 2 ? 24 : 16);
+    std::memcpy(data, sector + offset, DATA_SECTOR_SIZE);
+    return true;
+}
+
+/* Look up name in the directory at extent, then */
+/* return the extent and length of the entry. */
+bool CDDisk::find_entry(uint& extent, uint& length, const std::string& name)
+{
+    ubyte sector[DATA_SECTOR_SIZE];
+
+    for (uint offset = 0; offset < length; offset += DATA_SECTOR_SIZE) {
+        if (!read_data(extent + offset / DATA_SECTOR_SIZE, sector))
+            return false;
+
+        /* Records do not cross sectors, a zero length ends the sector. */
+        uint pos = 0;
+        while (pos + 33 < DATA_SECTOR_SIZE && sector[pos] != 0) {
+            ubyte* record = sector + pos;
+            uint name_length = std::min<uint>(record[32], DATA_SECTOR_SIZE - pos - 33);
+
+            /* Drop the ";1" version suffix. */
+            std::string entry((const char*)record + 33, name_length);
+            entry = entry.substr(0, entry.find(';'));
+
+            bool match = entry.size() == name.size() && std::equal(entry.begin(), entry.end(), name.begin(),
+                [](char a, char b) { return std::toupper(a) == std::toupper(b); });
+
+            if (match) {
+                std::memcpy(&extent, record + 2, 4);
+                std::memcpy(&length, record + 10, 4);
+                return true;
+            }
+
+            pos += record[0];
+        }
+    }
+
+    return false;
+}
+
+/* Read a file by its path, components are separated by \ or /. */
+bool CDDisk::read_file(const std::string& path, std::vector<ubyte>& data)
+{
+    ubyte sector[DATA_SECTOR_SIZE];
+    if (!read_data(ISO_PVD_LBA, sector) || sector[0] != 1 || std::memcmp(sector + 1, "CD001", 5) != 0)
+        return false;
+
+    uint extent, length;
+    std::memcpy(&extent, sector + ISO_ROOT_RECORD + 2, 4);
+    std::memcpy(&length, sector + ISO_ROOT_RECORD + 10, 4);
+
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find_first_of("\\/", start);
+        if (end == std::string::npos)
+            end = path.size();
+
+        if (end > start && !find_entry(extent, length, path.substr(start, end - start)))
+            return false;
+
+        start = end + 1;
+    }
+
+    data.resize(length);
+    for (uint offset = 0; offset < length; offset += DATA_SECTOR_SIZE) {
+        if (!read_data(extent + offset / DATA_SECTOR_SIZE, sector))
+            return false;
+
+        std::memcpy(data.data() + offset, sector, std::min(DATA_SECTOR_SIZE, length - offset));
+    }
+
+    return true;
+}
@@ -6,6 +6,13 @@ constexpr uint SECTOR_SIZE = 2352;
 constexpr uint SECTORS_PER_SECOND = 75;
 constexpr uint PREGAP_FRAME_COUNT = SECTORS_PER_SECOND * 2;
 
+/* User data of a Mode 1 or Mode 2 Form 1 sector. */
+constexpr uint DATA_SECTOR_SIZE = 2048;
+
+/* ISO9660 primary volume descriptor and its root directory record. */
+constexpr uint ISO_PVD_LBA = 16;
+constexpr uint ISO_ROOT_RECORD = 156;
+
 enum class DataType {
     Invalid,
     Audio,
@@ -67,8 +74,13 @@ public:
     CDPos size();
     bool is_empty();
 
+    /* ISO9660 access to the data track. */
+    bool read_data(uint lba, ubyte* data);
+    bool read_file(const std::string& path, std::vector<ubyte>& data);
+
 private:
     void create_track_for_bin(const std::string& bin_path);
+    bool find_entry(uint& extent, uint& length, const std::string& name);
 
     std::string filepath;
     std::vector<CDTrack> tracks;
@@ -48,50 +48,68 @@ void CDManager::insert_disk(const fs::path& file_path) {
     status_code.shell_open = false;
 }
 
-void CDManager::tick() {
+/* The response of a command is ready. */
+void CDManager::response_event() {
     status.transmit_busy = false;
+    update_irq();
+}
 
+/* Raise the interrupt on the rising edge of INT flags & INT enable. */
+void CDManager::update_irq() {
+    bool line = false;
     if (!irq_fifo.empty()) {
         auto irq_triggered = irq_fifo.front() & 0b111;
         auto irq_mask = int_enable & 0b111;
 
-        if (irq_triggered & irq_mask)
-            bus->irq(Interrupt::CDROM);
+        line = (irq_triggered & irq_mask) != 0;
     }
 
+    if (line && !irq_line)
+        bus->irq(Interrupt::CDROM);
+
+    irq_line = line;
+}
+
+void CDManager::start_reading() {
+    if (!bus->scheduler.is_scheduled(EventType::CDROMSector))
+        bus->scheduler.schedule(EventType::CDROMSector, READ_SECTOR_DELAY_STEPS * CDROM_STEP_CYCLES);
+}
+
+void CDManager::sector_event() {
     constexpr std::array<ubyte, 12> SYNC_MAGIC = { { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
                                                   0xff, 0xff, 0x00 } };
 
-    if (status_code.reading || status_code.playing) {
-        if (--steps_until_read_sect == 0) {
-            steps_until_read_sect = READ_SECTOR_DELAY_STEPS;
+    /* Stop once the drive is no longer reading. */
+    if (!status_code.reading && !status_code.playing)
+        return;
 
-            DataType sector_type;
-            const auto pos_to_read = CDPos::from_lba(read_sector);
-            read_buffer = cd_disk.read(pos_to_read, sector_type);
+    start_reading();
 
-            read_sector++;
+    DataType sector_type;
+    const auto pos_to_read = CDPos::from_lba(read_sector);
+    read_buffer = cd_disk.read(pos_to_read, sector_type);
 
-            if (sector_type == DataType::Invalid)
-                return;
+    read_sector++;
 
-            const auto sector_has_data = (sector_type == DataType::Data);
-            const auto sector_has_audio = (sector_type == DataType::Audio);
+    if (sector_type == DataType::Invalid)
+        return;
 
-            auto sync_match = std::equal(SYNC_MAGIC.begin(), SYNC_MAGIC.end(), read_buffer.begin());
+    const auto sector_has_data = (sector_type == DataType::Data);
+    const auto sector_has_audio = (sector_type == DataType::Audio);
 
-            if (status_code.playing && sector_has_audio) {  // Reading audio
-                if (sync_match)
-                    printf("Sync data found in Audio sector\n");
-            }
-            else if (status_code.reading && sector_has_data) {  // Reading data
-                if (!sync_match)
-                    printf("Sync data mismach in Data sector\n");
+    auto sync_match = std::equal(SYNC_MAGIC.begin(), SYNC_MAGIC.end(), read_buffer.begin());
 
-                // ack more data
-                push_response(CDResponse::SecondInt1, status_code.byte);
-            }
-        }
+    if (status_code.playing && sector_has_audio) {  // Reading audio
+        if (sync_match)
+            printf("Sync data found in Audio sector\n");
+    }
+    else if (status_code.reading && sector_has_data) {  // Reading data
+        if (!sync_match)
+            printf("Sync data mismach in Data sector\n");
+
+        // ack more data
+        push_response(CDResponse::SecondInt1, status_code.byte);
+        update_irq();
     }
 }
 
@@ -172,6 +190,7 @@ void CDManager::write(uint addr_rebased, ubyte val) {
     }
     else if (reg == 2 && reg_index == 1) {  // Interrupt Enable Register
         int_enable = val;
+        update_irq();
     }
     else if (reg == 2 && reg_index == 2) {  // Audio Volume for Left-CD-Out to Left-SPU-Input
     }
@@ -199,6 +218,11 @@ void CDManager::write(uint addr_rebased, ubyte val) {
         }
         if (!irq_fifo.empty())
             irq_fifo.pop_front();
+
+        /* The line drops, the next response follows after a delay. */
+        irq_line = false;
+        if (!irq_fifo.empty())
+            bus->scheduler.schedule(EventType::CDROMResponse, CDROM_STEP_CYCLES);
     }
     else if (reg == 3 && reg_index == 2) {  // Audio Volume for Left-CD-Out to Right-SPU-Input
     }
@@ -244,6 +268,7 @@ uint CDManager::read_word() {
 void CDManager::execute_command(ubyte cmd) {
     irq_fifo.clear();
     response_fifo.clear();
+    irq_line = false;
 
     //LOG_DEBUG_CDROM("CDROM command issued: {} ({:02X})", get_cmd_name(cmd), cmd);
 
@@ -271,6 +296,7 @@ void CDManager::execute_command(ubyte cmd) {
         read_sector = seek_sector;
 
         status_code.set_state(CDReadState::Playing);
+        start_reading();
 
         push_response_stat(CDResponse::FirstInt3);
         break;
@@ -278,6 +304,7 @@ void CDManager::execute_command(ubyte cmd) {
         read_sector = seek_sector;
 
         status_code.set_state(CDReadState::Reading);
+        start_reading();
 
         push_response_stat(CDResponse::FirstInt3);
         break;
@@ -403,6 +430,7 @@ void CDManager::execute_command(ubyte cmd) {
         read_sector = seek_sector;
 
         status_code.set_state(CDReadState::Reading);
+        start_reading();
 
         push_response_stat(CDResponse::FirstInt3);
         break;
@@ -428,6 +456,8 @@ void CDManager::execute_command(ubyte cmd) {
     param_fifo.clear();
 
     status.transmit_busy = true;
+    bus->scheduler.schedule(EventType::CDROMResponse, CDROM_STEP_CYCLES);
+
     status.param_fifo_empty = true;
     status.param_fifo_write_ready = true;
     status.adpcm_fifo_empty = false;
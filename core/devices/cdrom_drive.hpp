@@ -4,8 +4,9 @@
 #include <initializer_list>
 #include <deque>
 
-/* IRQ delay in CD-ROM steps (each one is 100 CPU cycles). */
+/* IRQ delay in CD-ROM steps (each one is CDROM_STEP_CYCLES). */
 constexpr uint READ_SECTOR_DELAY_STEPS = 1150;
+constexpr uint CDROM_STEP_CYCLES = 300;
 constexpr uint MAX_FIFO_SIZE = 16;
 
 enum class CDResponse : ubyte {
@@ -84,7 +85,10 @@ public:
     ~CDManager() = default;
 
     void insert_disk(const fs::path& file_path);
-    void tick();
+
+    /* Scheduler events. */
+    void response_event();
+    void sector_event();
     
     /* Bus read/write */
     ubyte read(uint addr);
@@ -93,12 +97,17 @@ public:
     ubyte read_byte();
     uint read_word();
 
+    /* The inserted disc, for reading files off it. */
+    CDDisk& disk() { return cd_disk; }
+
 private:
     void execute_command(ubyte cmd);
     inline void push_response(CDResponse type, std::initializer_list<ubyte> bytes);
     inline void push_response(CDResponse type, ubyte byte);
     inline void push_response_stat(CDResponse type);
     void command_error();
+    void update_irq();
+    void start_reading();
     ubyte get_param();
     bool is_data_buf_empty();
 
@@ -109,7 +118,6 @@ private:
 
 private:
     CDDisk cd_disk;
-
     CDMODE mode;
     CDSTAT status;
     CDSTATCODE status_code;
@@ -121,8 +129,7 @@ private:
     ubyte int_enable = 0;
     uint data_buffer_index = 0;
     uint seek_sector = 0, read_sector = 0;
-    uint steps_until_read_sect = READ_SECTOR_DELAY_STEPS;
 
-    bool muted = false;
+    bool muted = false, irq_line = false;
     Bus* bus;
 };
@@ -118,20 +118,18 @@ void Controller::default_mapping()
     key_lookup[GLFW_KEY_ENTER] = Button::Square;
 }
 
-bool ControllerManager::tick()
+void ControllerManager::start_ack()
 {
-    if (counter > 0) {
-        counter -= 100;
-        if (counter == 0) {
-            status.ack_input_level = false;
-            status.irq_request = true;
-        }
-    }
+    bus->scheduler.schedule(EventType::ControllerAck, CONTROLLER_ACK_CYCLES);
+}
 
-    if (status.irq_request)
-        bus->irq(Interrupt::CONTROLLER);
+/* The device acknowledged the byte. */
+void ControllerManager::ack_event()
+{
+    status.ack_input_level = false;
+    status.irq_request = true;
 
-    return false;
+    bus->irq(Interrupt::CONTROLLER);
 }
 
 void ControllerManager::reload()
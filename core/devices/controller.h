@@ -86,6 +86,9 @@ union JOYCTRL {
 
 typedef ushort JOYBAUD;
 
+/* Delay of the /ACK pulse after a transferred byte. */
+constexpr uint CONTROLLER_ACK_CYCLES = 1500;
+
 class Controller {
 public:
     Controller();
@@ -116,7 +119,8 @@ public:
     ControllerManager(Bus* _bus);
     ~ControllerManager() = default;
 
-    bool tick();
+    void ack_event();
+    void start_ack();
     void reload();
 
     template <typename T>
@@ -127,7 +131,6 @@ public:
 
 public:
     std::deque<ubyte> tx_data, rx_data;
-    uint counter;
 
     JOYSTAT status;
     JOYMODE mode;
@@ -196,7 +199,7 @@ inline void ControllerManager::write(uint addr, uint value)
         }
 
         if (control.acknowledge)
-            counter = 500;
+            start_ack();
     }
     else if (offset == 0x48) {
         mode.value = value;
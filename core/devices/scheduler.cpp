@@ -0,0 +1,64 @@
+#include <stdafx.hpp>
+#include "scheduler.h"
+
+/* Orders the heap so the earliest deadline is at the front. */
+static bool later(const Event& a, const Event& b)
+{
+	return a.time > b.time;
+}
+
+void Scheduler::schedule(EventType type, ulong delay)
+{
+	uint index = (uint)type;
+	scheduled[index] = true;
+
+	heap.push_back({ now() + delay, type, ++generations[index] });
+	std::push_heap(heap.begin(), heap.end(), later);
+}
+
+void Scheduler::cancel(EventType type)
+{
+	uint index = (uint)type;
+	scheduled[index] = false;
+	generations[index]++;
+}
+
+bool Scheduler::is_scheduled(EventType type) const
+{
+	return scheduled[(uint)type];
+}
+
+/* Remove the cancelled or rescheduled events from the top. */
+void Scheduler::drop_stale()
+{
+	while (!heap.empty()) {
+		auto& top = heap.front();
+		if (top.generation == generations[(uint)top.type])
+			break;
+
+		std::pop_heap(heap.begin(), heap.end(), later);
+		heap.pop_back();
+	}
+}
+
+ulong Scheduler::next_deadline()
+{
+	drop_stale();
+	return (heap.empty() ? ULLONG_MAX : heap.front().time);
+}
+
+bool Scheduler::pop_due(EventType& type)
+{
+	drop_stale();
+
+	if (heap.empty() || heap.front().time > now())
+		return false;
+
+	type = heap.front().type;
+	scheduled[(uint)type] = false;
+
+	std::pop_heap(heap.begin(), heap.end(), later);
+	heap.pop_back();
+
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <utility/types.hpp>
+
+/* Device work that happens at a point in time. */
+enum class EventType : ubyte {
+	Scanline,
+	HBlankEnd,
+	Timer0,
+	Timer1,
+	Timer2,
+	CDROMResponse,
+	CDROMSector,
+	ControllerAck,
+	DMAIrq,
+	ProfilerSample,
+	Count
+};
+
+struct Event {
+	ulong time;
+	EventType type;
+	uint generation;
+};
+
+/* Keeps the pending device events in a min-heap ordered by */
+/* their deadline in CPU cycles. Each type is pending at most */
+/* once: rescheduling bumps its generation, and the stale */
+/* heap entries are dropped when they reach the top. */
+class Scheduler {
+public:
+	Scheduler() = default;
+	~Scheduler() = default;
+
+	/* Time is read from the CPU cycle counter. */
+	void set_clock(const ulong* cycles) { clock = cycles; }
+	ulong now() const { return *clock; }
+
+	void schedule(EventType type, ulong delay);
+	void cancel(EventType type);
+	bool is_scheduled(EventType type) const;
+
+	/* Deadline of the earliest event. */
+	ulong next_deadline();
+
+	/* Pop the next event whose deadline has passed. */
+	bool pop_due(EventType& type);
+
+private:
+	void drop_stale();
+
+private:
+	const ulong* clock = nullptr;
+	std::vector<Event> heap;
+	uint generations[(uint)EventType::Count] = {};
+	bool scheduled[(uint)EventType::Count] = {};
+};
@@ -20,6 +20,8 @@ Timer::Timer(TimerID type, Bus* _bus)
 
 uint Timer::read(uint address)
 {
+	sync();
+
 	switch (address & 0xf) {
 	case 0x0: /* Write to Counter value. */
 		return current.value;
@@ -34,6 +36,8 @@ uint Timer::read(uint address)
 
 void Timer::write(uint address, uint data)
 {
+	sync();
+
 	switch (address & 0xf) {
 	case 0x0: /* Write to Counter value. */
 		current.raw = data;
@@ -63,6 +67,8 @@ void Timer::write(uint address, uint data)
 		target.raw = data;
 		break;
 	}
+
+	schedule();
 }
 
 void Timer::fire_irq()
@@ -203,6 +209,54 @@ void Timer::tick(uint cycles)
 	}
 }
 
+/* Add the cycles elapsed since the last sync. */
+void Timer::sync()
+{
+	auto& scheduler = bus->scheduler;
+
+	tick((uint)(scheduler.now() - last_sync));
+	last_sync = scheduler.now();
+
+	schedule();
+}
+
+/* Wake up when the counter reaches the target or overflows, */
+/* timers that cannot raise an interrupt are never woken. */
+void Timer::schedule()
+{
+	auto& scheduler = bus->scheduler;
+	auto event = (EventType)((uint)EventType::Timer0 + (uint)timer_id);
+
+	uint ticks = UINT_MAX;
+	if (mode.irq_when_target && current.raw < target.target)
+		ticks = target.target - current.raw;
+	if (mode.irq_when_overflow && current.raw < 0xffff)
+		ticks = std::min(ticks, 0xffff - current.raw);
+
+	if (ticks == UINT_MAX) {
+		scheduler.cancel(event);
+		return;
+	}
+
+	/* Convert counter ticks to CPU cycles. */
+	ulong cycles = ticks;
+	switch (get_clock_source()) {
+	case ClockSrc::SystemDiv8:
+		cycles = cycles * 8 - count;
+		break;
+	case ClockSrc::Hblank:
+		cycles = cycles * 2160 - count;
+		break;
+	case ClockSrc::Dotclock:
+		cycles = (cycles * 7 * std::max(dot_div, 1u) + 10) / 11;
+		break;
+	default:
+		break;
+	}
+
+	scheduler.schedule(event, std::max<ulong>(cycles, 1));
+}
+
 void Timer::gpu_sync(GPUSync sync)
 {
 	prev_hblank = in_hblank;
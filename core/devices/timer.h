@@ -111,6 +111,10 @@ public:
 	void tick(uint cycles);
 	void gpu_sync(GPUSync sync);
 
+	/* Catch up with the scheduler and plan the next interrupt. */
+	void sync();
+	void schedule();
+
 	/* Map timer to interrupt type. */
 	Interrupt irq_type();
 
@@ -133,6 +137,7 @@ public:
 	bool in_hblank, in_vblank;
 	bool prev_hblank, prev_vblank;
 	uint count, dot_div = 0;
+	ulong last_sync = 0;
 
 	TimerID timer_id;
 	Bus* bus;
@@ -1,15 +1,78 @@
 #include <stdafx.hpp>
 #include <video/renderer.h>
 #include <memory/bus.h>
+#include <cpu/cpu.h>
+#include <tools/lockstep.h>
 
-int main()
+int main(int argc, char** argv)
 {
-	auto emulator = std::make_unique<Bus>("./bios/SCPH1001.BIN");
+	/* Check a fast CPU backend against the interpreter, without a window. */
+	if (argc > 1 && std::string(argv[1]) == "--lockstep")
+		return run_lockstep(argc - 2, argv + 2);
 
-	std::string game_file = "C:\\Users\\Alex\\Desktop\\PSXemu\\roms\\RIDGERACERUSA.BIN";
-	emulator->cddrive->insert_disk(game_file);
+	/* --disc inserts a disc image, --fast-boot skips the */
+	/* BIOS intro and starts it, --exe starts a PS-X EXE */
+	/* instead. --headless runs without a window as fast */
+	/* as the host allows and draws into VRAM with the */
+	/* software renderer. --frames and --cycles end the */
+	/* run after that many frames or CPU cycles. --cpu picks */
+	/* the backend, idle loops are only skipped by the cached */
+	/* interpreter and the JIT. */
+	bool fast_boot = false, headless = false;
+	std::string boot_exe, disc_file;
+	ulong max_frames = 0, max_cycles = 0;
+	CPUMode mode = CPUMode::Interpreter;
 
-	while (emulator->renderer->is_open()) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--fast-boot")
+			fast_boot = true;
+		else if (arg == "--headless")
+			headless = true;
+		else if (arg == "--exe" && i + 1 < argc)
+			boot_exe = argv[++i];
+		else if (arg == "--disc" && i + 1 < argc)
+			disc_file = argv[++i];
+		else if (arg == "--frames" && i + 1 < argc)
+			max_frames = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--cycles" && i + 1 < argc)
+			max_cycles = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--cpu" && i + 1 < argc) {
+			std::string name = argv[++i];
+
+			if (name == "interpreter")
+				mode = CPUMode::Interpreter;
+			else if (name == "cached")
+				mode = CPUMode::CachedInterpreter;
+			else if (name == "jit")
+				mode = CPUMode::Recompiler;
+			else {
+				std::printf("usage: --cpu interpreter | cached | jit\n");
+				return 2;
+			}
+		}
+	}
+
+	auto emulator = std::make_unique<Bus>("./bios/SCPH1001.BIN", true,
+		headless ? RendererType::Software : RendererType::OpenGL);
+
+	CPU* cpu = emulator->cpu.get();
+	cpu->set_mode(mode);
+	cpu->fast_boot = fast_boot || !boot_exe.empty();
+	cpu->boot_exe = boot_exe;
+
+	if (!disc_file.empty())
+		emulator->cddrive->insert_disk(disc_file);
+
+	while (emulator->renderer->is_open() && !cpu->stopped) {
 		emulator->tick();
+
+		if (max_frames != 0 && emulator->gpu->frame_count >= max_frames)
+			break;
+		if (max_cycles != 0 && cpu->cycles >= max_cycles)
+			break;
 	}
+
+	return cpu->exit_code;
 }
\ No newline at end of file
@@ -2,38 +2,69 @@
 #include "bus.h"
 #include <video/vram.h>
 #include <glad/glad.h>
-#include <video/renderer.h>
+#include <video/opengl/gl_renderer.h>
+#include <video/null_renderer.h>
+#include <video/software/software_renderer.h>
 #include <cpu/cpu.h>
 #include <sound/spu.hpp>
 #include <memory/expansion2.hpp>
-
-std::vector<ubyte> load_file(fs::path const& filepath) 
+#include <tools/profiler.h>
+#include <utility/mapped_file.hpp>
+
+/* Header of a PS-X EXE, the payload starts at PSXEXE_HEADER_SIZE. */
+struct PSXEXEHeader {
+	char magic[8];  // "PS-X EXE"
+	ubyte pad0[8];
+	uint pc;         // initial PC
+	uint r28;        // initial R28
+	uint load_addr;  // destination address in RAM
+	uint filesize;   // excluding header & must be N*0x800
+	uint unk0[2];
+	uint memfill_start;
+	uint memfill_size;
+	uint r29_r30;         // initial r29 and r30 base
+	uint r29_r30_offset;  // initial r29 and r30 offset, added to above
+	// etc, we don't care about anything else
+};
+
+constexpr uint PSXEXE_HEADER_SIZE = 0x800;
+
+Bus::Bus(const std::string& bios_path, bool use_fastmem, RendererType renderer_type)
 {
-	std::ifstream ifs(filepath, std::ios::binary | std::ios::ate | std::ios::in);
-
-	if (!ifs)
-		throw std::runtime_error(filepath.string() + ": " + std::strerror(errno));
+	/* Guest memory is shared with the fastmem window if the host supports it. */
+	if (use_fastmem)
+		fastmem = Fastmem::create();
 
-	const auto size = ifs.tellg();
-	ifs.seekg(0, std::ios::beg);
-
-	if (size == 0) {
-		__debugbreak();
-		return {};
+	ubyte* block = nullptr;
+	if (fastmem != nullptr) {
+		block = fastmem->memory;
+	}
+	else {
+		memory.resize(GUEST_MEMORY_SIZE);
+		block = memory.data();
 	}
 
-	std::vector<ubyte> buf(size);
-
-	if (!ifs.read((char*)buf.data(), buf.size()))
-		throw std::runtime_error(filepath.string() + ": " + std::strerror(errno));
+	ram = block;
+	bios = ram + GUEST_RAM_SIZE;
+	scratchpad = bios + GUEST_BIOS_SIZE;
 
-	return buf;
-}
+	/* Map memory before anything can access it. */
+	map_pages();
 
-Bus::Bus(const std::string& bios_path)
-{
 	/* Construct components. */
-	renderer = std::make_unique<Renderer>(640, 480, "Playstation 1 emulator", this);
+	/* Headless buses have no window, VRAM lives in host memory. */
+	if (renderer_type == RendererType::Software) {
+		renderer = std::make_unique<SoftwareRenderer>(this);
+	}
+	else if (renderer_type == RendererType::Null) {
+		renderer = std::make_unique<NullRenderer>();
+	}
+	else {
+		auto gl_renderer = std::make_unique<GLRenderer>(640, 480, "Playstation 1 emulator", this);
+		window = gl_renderer->window;
+		renderer = std::move(gl_renderer);
+	}
+
 	cpu = std::make_shared<CPU>(this);
 	gpu = std::make_unique<GPU>(renderer.get());
 	spu = std::make_shared<SPU>(this);
@@ -47,19 +78,33 @@ Bus::Bus(const std::string& bios_path)
 	controller = std::make_unique<ControllerManager>(this);
 	cddrive = std::make_unique<CDManager>(this);
 
+	/* Start the video timing. */
+	scheduler.set_clock(&cpu->cycles);
+	scheduler.schedule(EventType::Scanline, gpu->cycles_until_scanline());
+
+	/* Open BIOS file. */
+	util::read_binary_file(bios_path, 512 * 1024, bios);
+
+	/* Stays idle until started from the debugger. */
+	profiler = std::make_unique<Profiler>(this);
+
+	if (renderer_type != RendererType::OpenGL)
+		return;
+
 	/* Construct debugging tools. */
 	debugger = std::make_unique<Debugger>(this);
 	debugger->push_widget<CPUWidget>();
 	debugger->push_widget<MemWidget>();
-
-	/* Open BIOS file. */
-	util::read_binary_file(bios_path, 512 * 1024, bios);
+	debugger->push_widget<KernelWidget>();
 
 	/* Configure window. */
-	glfwSetWindowUserPointer(renderer->window, this);
-	glfwSetKeyCallback(renderer->window, &Bus::key_callback);
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, &Bus::key_callback);
 }
 
+/* Defined here so the renderer type is complete. */
+Bus::~Bus() = default;
+
 /* Get the physical memory address from the virtual one. */
 uint Bus::physical_addr(uint addr)
 {
@@ -67,6 +112,57 @@ uint Bus::physical_addr(uint addr)
     return (addr & region_mask[index]);
 }
 
+/* Fill the page tables with RAM, BIOS and scratchpad. */
+void Bus::map_pages()
+{
+	read_table.assign(MEM_PAGE_COUNT, nullptr);
+	write_table.assign(MEM_PAGE_COUNT, nullptr);
+
+	auto map = [&](uint addr, ubyte* host, bool writable) {
+		read_table[addr >> MEM_PAGE_SHIFT] = host;
+		if (writable) write_table[addr >> MEM_PAGE_SHIFT] = host;
+	};
+
+	/* KUSEG, KSEG0 and KSEG1 see the same physical memory. */
+	for (uint segment : { 0x00000000u, 0x80000000u, 0xA0000000u }) {
+		for (uint offset = 0; offset < RAM.length; offset += MEM_PAGE_SIZE)
+			map(segment + offset, ram + (offset & 0x1fffff), true);
+
+		for (uint offset = 0; offset < BIOS.length; offset += MEM_PAGE_SIZE)
+			map(segment + BIOS.start + offset, bios + offset, false);
+
+		map(segment + SCRATCHPAD.start, scratchpad, true);
+	}
+}
+
+/* Remove or restore the write mappings of a physical */
+/* page in every segment and RAM mirror. */
+void Bus::protect_page(uint abs_addr, bool protect)
+{
+	uint page = abs_addr & ~MEM_PAGE_MASK;
+	ubyte* host = protect ? nullptr : read_table[page >> MEM_PAGE_SHIFT];
+
+	for (uint segment : { 0x00000000u, 0x80000000u, 0xA0000000u }) {
+		if (RAM.contains(page)) {
+			for (uint mirror = 0; mirror < RAM.length; mirror += GUEST_RAM_SIZE)
+				write_table[(segment + mirror + (page & 0x1fffff)) >> MEM_PAGE_SHIFT] = host;
+		}
+		else {
+			write_table[(segment + page) >> MEM_PAGE_SHIFT] = host;
+		}
+	}
+
+	if (fastmem != nullptr)
+		fastmem->protect(page, protect);
+}
+
+/* Drop compiled code that overlaps a physical range. */
+/* Used by writes that bypass Bus::write. */
+void Bus::invalidate_code(uint abs_addr, uint size)
+{
+	cpu->block_cache.invalidate(abs_addr, size);
+}
+
 /* Used for keyboard input detection. */
 /* TODO: Add mappable keyboard configurations. */
 void Bus::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -92,6 +188,11 @@ void Bus::key_callback(GLFWwindow* window, int key, int scancode, int action, in
 		}/* Toggle debugging utilities. */
 		else if (key == GLFW_KEY_F4) {
 			bus->debug_enable = !bus->debug_enable;
+		} /* Save the displayed image losslessly. */
+		else if (key == GLFW_KEY_F5) {
+			auto& gpu = bus->gpu;
+			vram.write_display_image("display_dump.png", gpu->display_area.x, gpu->display_area.y,
+				gpu->width[gpu->status.hres], gpu->height[gpu->status.vres], gpu->status.color_depth);
 		}
 	} /* Button was just released. */
 	else if (action == GLFW_RELEASE) {
@@ -99,83 +200,173 @@ void Bus::key_callback(GLFWwindow* window, int key, int scancode, int action, in
 	}
 }
 
-/* Load a Playstation Executable file. */
-/* NOTE: To execute it, the force_test function in the CPU must be called! */
-/* TODO: Have a clean API for loading .bin/.cue and .exe files. */
+/* Load a Playstation Executable file. The file is mapped and */
+/* its payload copied straight to RAM. */
+/* NOTE: To execute it, pass the load info to CPU::sideload. */
 bool Bus::loadEXE(std::string m_psxexe_path, PSEXELoadInfo& out_psx_load_info)
 {
-	if (m_psxexe_path.empty())
+	MappedFile file;
+	if (!file.open(m_psxexe_path)) {
+		printf("[BUS] Cannot open %s.\n", m_psxexe_path.c_str());
 		return false;
+	}
 
-	const std::vector<ubyte>& psx_exe_buf = load_file(m_psxexe_path);
+	return load_exe(file.data, file.size, out_psx_load_info);
+}
 
-	if (psx_exe_buf.empty())
-		return false;
+/* Offset in RAM of a guest range, or -1 when it does not fit. */
+static int ram_offset(Bus* bus, uint addr, uint size)
+{
+	uint physical = bus->physical_addr(addr);
+	if (physical >= GUEST_RAM_SIZE || size > GUEST_RAM_SIZE - physical)
+		return -1;
 
-	struct PSXEXEHeader {
-		char magic[8];  // "PS-X EXE"
-		ubyte pad0[8];
-		uint pc;         // initial PC
-		uint r28;        // initial R28
-		uint load_addr;  // destination address in RAM
-		uint filesize;   // excluding header & must be N*0x800
-		uint unk0[2];
-		uint memfill_start;
-		uint memfill_size;
-		uint r29_r30;         // initial r29 and r30 base
-		uint r29_r30_offset;  // initial r29 and r30 offset, added to above
-		// etc, we don't care about anything else
-	};
+	return (int)physical;
+}
 
-	const auto psx_exe = (PSXEXEHeader*)psx_exe_buf.data();
+/* Copy an executable image to RAM and clear its memfill area. */
+bool Bus::load_exe(const ubyte* data, size_t size, PSEXELoadInfo& out_psx_load_info)
+{
+	const auto psx_exe = (const PSXEXEHeader*)data;
+
+	if (size < PSXEXE_HEADER_SIZE || std::memcmp(&psx_exe->magic[0], "PS-X EXE", 8)) {
+		printf("[BUS] Not a valid PS-X EXE file.\n");
+		return false;
+	}
+
+	int load_offset = ram_offset(this, psx_exe->load_addr, psx_exe->filesize);
+	if (load_offset < 0) {
+		printf("[BUS] EXE payload %08x+%x is outside RAM.\n", psx_exe->load_addr, psx_exe->filesize);
+		return false;
+	}
 
-	if (std::strcmp(&psx_exe->magic[0], "PS-X EXE")) {
-		printf("Not a valid PS-X EXE file!");
-		exit(0);
+	int fill_offset = ram_offset(this, psx_exe->memfill_start, psx_exe->memfill_size);
+	if (psx_exe->memfill_size != 0 && fill_offset < 0) {
+		printf("[BUS] EXE memfill %08x+%x is outside RAM.\n", psx_exe->memfill_start, psx_exe->memfill_size);
 		return false;
 	}
 
-	// We don't support memfill
-	assert(psx_exe->memfill_start == 0);
-	assert(psx_exe->memfill_size == 0);
+	/* Some tools do not pad the file to the size in the */
+	/* header, the missing tail is cleared instead. */
+	size_t available = std::min<size_t>(psx_exe->filesize, size - PSXEXE_HEADER_SIZE);
+	std::memcpy(ram + load_offset, data + PSXEXE_HEADER_SIZE, available);
+	std::memset(ram + load_offset + available, 0, psx_exe->filesize - available);
+	invalidate_code(load_offset, psx_exe->filesize);
+
+	/* Like the BIOS, clear the area after loading. */
+	if (psx_exe->memfill_size != 0) {
+		std::memset(ram + fill_offset, 0, psx_exe->memfill_size);
+		invalidate_code(fill_offset, psx_exe->memfill_size);
+	}
+
+	/* The stack and frame pointer both start at base + offset, */
+	/* a zero base keeps the ones the BIOS set up. */
+	uint stack = (psx_exe->r29_r30 != 0 ? psx_exe->r29_r30 + psx_exe->r29_r30_offset : 0);
 
 	out_psx_load_info.pc = psx_exe->pc;
 	out_psx_load_info.r28 = psx_exe->r28;
-	out_psx_load_info.r29 = psx_exe->r29_r30;
-	out_psx_load_info.r30 = psx_exe->r29_r30 + psx_exe->r29_r30_offset;
+	out_psx_load_info.r29 = stack;
+	out_psx_load_info.r30 = stack;
 
-	constexpr auto PSXEXE_HEADER_SIZE = 0x800;
+	return true;
+}
 
-	const auto copy_src_begin = psx_exe_buf.data() + PSXEXE_HEADER_SIZE;
-	const auto copy_src_end = copy_src_begin + psx_exe->filesize;
-	const auto copy_dest_begin = ram + (psx_exe->load_addr & 0x7FFFFFFF);
+/* Find the boot executable of the inserted disc through */
+/* SYSTEM.CNF, like the shell does, and load it to RAM. */
+bool Bus::boot_disc(PSEXELoadInfo& info)
+{
+	CDDisk& disk = cddrive->disk();
+	std::string boot_path = "PSX.EXE";
 
-	std::copy(copy_src_begin, copy_src_end, copy_dest_begin);
+	/* The BOOT line reads like "BOOT = cdrom:\SLUS_000.01;1". */
+	std::vector<ubyte> config;
+	if (disk.read_file("SYSTEM.CNF", config)) {
+		std::istringstream lines(std::string(config.begin(), config.end()));
 
-	return true;
+		std::string line;
+		while (std::getline(lines, line)) {
+			size_t equals = line.find('=');
+			if (equals == std::string::npos || line.compare(0, 4, "BOOT") != 0)
+				continue;
+
+			size_t start = line.find(':', equals);
+			start = (start == std::string::npos ? equals : start) + 1;
+
+			std::string value = line.substr(start);
+			value.erase(0, value.find_first_not_of(" \t\\"));
+
+			boot_path = value.substr(0, value.find_first_of("; \t\r"));
+			break;
+		}
+	}
+
+	std::vector<ubyte> exe;
+	if (!disk.read_file(boot_path, exe)) {
+		printf("[BUS] Cannot read %s from the disc.\n", boot_path.c_str());
+		return false;
+	}
+
+	printf("[BUS] Booting %s from the disc.\n", boot_path.c_str());
+	return load_exe(exe.data(), exe.size(), info);
 }
 
-/* Tick the major components. */
+/* Run the CPU up to the next device event, then handle */
+/* every event that is due. Idle devices schedule nothing. */
 void Bus::tick()
 {
 	/* Tick the CPU. */
-	for (int i = 0; i < 100; i++) {
-		cpu->tick();
-	}
+	cpu->run_until(scheduler.next_deadline());
 
-	/* Handle requested interrupts. */
-	cpu->handle_interrupts();
+	/* Interrupts raised by the events are taken */
+	/* by the CPU before it runs the next block. */
+	handle_events();
+}
 
-	/* Tick the peripherals. */
-	dma->tick();
-	controller->tick();
-	cddrive->tick();
+/* Handle every event that is due. */
+void Bus::handle_events()
+{
+	EventType type;
+	while (scheduler.pop_due(type))
+		handle_event(type);
+}
+
+void Bus::handle_event(EventType type)
+{
+	switch (type) {
+	case EventType::Scanline:
+		return scanline_event();
+	case EventType::HBlankEnd:
+		return hblank_end_event();
+	case EventType::Timer0:
+	case EventType::Timer1:
+	case EventType::Timer2:
+		return timers[(uint)type - (uint)EventType::Timer0]->sync();
+	case EventType::CDROMResponse:
+		return cddrive->response_event();
+	case EventType::CDROMSector:
+		return cddrive->sector_event();
+	case EventType::ControllerAck:
+		return controller->ack_event();
+	case EventType::DMAIrq:
+		return dma->irq_event();
+	case EventType::ProfilerSample:
+		return profiler->sample();
+	default:
+		break;
+	}
+}
+
+/* The GPU finished a scanline and entered the blanking period. */
+void Bus::scanline_event()
+{
+	uint elapsed = (uint)(scheduler.now() - last_scanline);
+	last_scanline = scheduler.now();
 
 	/* Tick the GPU. */
 	/* NOTE: The function returns a bool indicating */
 	/* if it is Vblank or not. So anything in the brackets */
 	/* will only be executed in Vblank. */
-	if (gpu->tick(300)) {
+	if (gpu->tick(elapsed)) {
 		/* Display draw data. */
 		renderer->update();
 
@@ -192,15 +383,27 @@ void Bus::tick()
 	}
 
 	/* Sync the timers with the GPU */
+	/* NOTE: Timer 2 does not sync with the GPU! */
 	GPUSync sync = gpu->get_blanks_and_dot();
-	/* Tick timers. */
 	for (int i = 0; i < 2; i++) {
-		timers[i]->tick(300);
+		timers[i]->sync();
 		timers[i]->gpu_sync(sync);
 	}
 
-	/* NOTE: Timer 2 does not sync with the GPU! */
-	timers[2]->tick(300);
+	scheduler.schedule(EventType::HBlankEnd, HBLANK_CYCLES);
+	scheduler.schedule(EventType::Scanline, gpu->cycles_until_scanline());
+}
+
+void Bus::hblank_end_event()
+{
+	GPUSync sync = gpu->get_blanks_and_dot();
+	sync.hblank = false;
+	sync.vblank = false;
+
+	for (int i = 0; i < 2; i++) {
+		timers[i]->sync();
+		timers[i]->gpu_sync(sync);
+	}
 }
 
 /* Trigger an interrupt. */
@@ -213,6 +416,11 @@ void Bus::irq(Interrupt interrupt) const
 template<typename T>
 T Bus::read(uint addr)
 {
+	/* RAM, BIOS and scratchpad are read through the page table. */
+	ubyte* page = read_table[addr >> MEM_PAGE_SHIFT];
+	if (page != nullptr)
+		return util::read_memory<T>(page, addr & MEM_PAGE_MASK);
+
 	/* Map the memory ranges. */
 	uint abs_addr = physical_addr(addr);
 
@@ -224,7 +432,7 @@ T Bus::read(uint addr)
 		return timers[timer]->read(abs_addr);
 	}
 	else if (RAM.contains(abs_addr)) {
-		int offset = RAM.offset(abs_addr);
+		int offset = RAM.offset(abs_addr) & 0x1fffff;
 		return util::read_memory<T>(ram, offset);
 	}
 	else if (BIOS.contains(abs_addr)) {
@@ -270,6 +478,11 @@ T Bus::read(uint addr)
 template<typename T>
 void Bus::write(uint addr, T value)
 {
+	/* Writes to RAM and scratchpad without code take the page table. */
+	ubyte* page = write_table[addr >> MEM_PAGE_SHIFT];
+	if (page != nullptr)
+		return util::write_memory<T>(page, addr & MEM_PAGE_MASK, value);
+
 	/* Map the memory ranges. */
 	uint abs_addr = physical_addr(addr);
 	if (TIMERS.contains(abs_addr)) {
@@ -284,7 +497,11 @@ void Bus::write(uint addr, T value)
 	}
 	else if (SCRATCHPAD.contains(abs_addr)) {
 		int offset = SCRATCHPAD.offset(abs_addr);
-		return util::write_memory(scratchpad, offset, value);
+		util::write_memory(scratchpad, offset, value);
+
+		if (cpu->block_cache.code_pages[SCRATCHPAD_CODE_PAGE])
+			cpu->block_cache.invalidate(abs_addr, sizeof(T));
+		return;
 	}
 	else if (CDROM.contains(abs_addr)) {
 		if (std::is_same<T, ubyte>::value)
@@ -297,8 +514,13 @@ void Bus::write(uint addr, T value)
 		return spu->write<T>(abs_addr, value);
 	}
 	else if (RAM.contains(abs_addr)) {
-		int offset = RAM.offset(abs_addr);
-		return util::write_memory<T>(ram, offset, value);
+		int offset = RAM.offset(abs_addr) & 0x1fffff;
+		util::write_memory<T>(ram, offset, value);
+
+		/* Drop any code compiled from this page. */
+		if (cpu->block_cache.code_pages[offset >> CODE_PAGE_SHIFT])
+			cpu->block_cache.invalidate(abs_addr, sizeof(T));
+		return;
 	}
 	else if (CACHE_CONTROL.contains(abs_addr)) {
 		int offset = CACHE_CONTROL.offset(abs_addr);
@@ -1,11 +1,14 @@
 #pragma once
 #include <memory/dma.h>
+#include <memory/fastmem.h>
 #include <devices/cdrom_drive.hpp>
 #include <devices/timer.h>
+#include <devices/scheduler.h>
 #include <devices/controller.h>
 #include <tools/debugger.hpp>
 #include <cpu/cache.h>
 #include <video/gpu_core.h>
+#include <video/renderer.h>
 #include <devices/timer.h>
 
 enum class ExceptionType {
@@ -27,17 +30,23 @@ struct PSEXELoadInfo {
 	uint r30;
 };
 
+/* Software page table, maps 4KB virtual pages to host memory. */
+constexpr uint MEM_PAGE_SHIFT = 12;
+constexpr uint MEM_PAGE_SIZE = 1 << MEM_PAGE_SHIFT;
+constexpr uint MEM_PAGE_MASK = MEM_PAGE_SIZE - 1;
+constexpr uint MEM_PAGE_COUNT = 1 << (32 - MEM_PAGE_SHIFT);
+
 /* Forward declarations. */
 class CPU;
 class SPU;
-class Renderer;
 class Expansion2;
+class Profiler;
 
 struct GLFWwindow;
 class Bus {
 public:
-	Bus(const std::string& bios_path);
-	~Bus() = default;
+	Bus(const std::string& bios_path, bool use_fastmem = true, RendererType renderer_type = RendererType::OpenGL);
+	~Bus();
 
 	template <typename T = uint>
 	T read(uint addr);
@@ -46,14 +55,30 @@ public:
 	void write(uint addr, T data);
 
 	void tick();
+	void handle_events();
+	void handle_event(EventType type);
 	void irq(Interrupt interrupt) const;
 	uint physical_addr(uint addr);
+	void invalidate_code(uint abs_addr, uint size);
+
+	void map_pages();
+	void protect_page(uint abs_addr, bool protect);
 	
 	bool loadEXE(std::string test, PSEXELoadInfo& info);
+	bool load_exe(const ubyte* data, size_t size, PSEXELoadInfo& info);
+	bool boot_disc(PSEXELoadInfo& info);
 	static void key_callback(GLFWwindow* window, int key, int scancode,
 												 int action, int mods);
 
+private:
+	void scanline_event();
+	void hblank_end_event();
+
 public:
+	/* Device timing. */
+	Scheduler scheduler;
+	ulong last_scanline = 0;
+
 	/* Peripherals. */
 	std::unique_ptr<Timer> timers[3];
 	std::unique_ptr<DMAController> dma;
@@ -63,22 +88,38 @@ public:
 	/* Components. */
 	std::unique_ptr<Renderer> renderer;
 	std::unique_ptr<GPU> gpu;
+
+	/* Only set when rendering to a window. */
+	GLFWwindow* window = nullptr;
 	std::shared_ptr<CPU> cpu;
 	std::shared_ptr<SPU> spu;
 	std::shared_ptr<Expansion2> exp2;
 
 	/* Debugging. */
 	std::unique_ptr<Debugger> debugger;
+	std::unique_ptr<Profiler> profiler;
 	bool debug_enable = false;
 
 	/* Memory regions. */
 	uint spu_delay = 0;
 	ubyte registers[4 * 1024] = {};
-	ubyte ram[2048 * 1024] = {};
-	ubyte scratchpad[1024] = {};
-	ubyte bios[512 * 1024] = {};
 	ubyte ex1[512 * 1024] = {};
+
+	/* RAM, BIOS and scratchpad, allocated in one block. */
+	/* NOTE: only 1KB of the scratchpad is used, it is padded to fill a page. */
+	ubyte* ram = nullptr;
+	ubyte* bios = nullptr;
+	ubyte* scratchpad = nullptr;
+	std::vector<ubyte> memory;
+
+	/* Host window used by the recompiler, null if disabled. */
+	std::unique_ptr<Fastmem> fastmem;
 	
+	/* Host pointer of every virtual page, null for MMIO. */
+	/* Pages holding compiled code are absent from the */
+	/* write table so stores reach Bus::write. */
+	std::vector<ubyte*> read_table, write_table;
+
 	/* Mask repeated memory regions. */
 	const uint region_mask[8] = {
 		0xffffffff, 0xffffffff,
@@ -88,7 +129,7 @@ public:
 	};
 
 	/* Memory ranges. */
-	const Range RAM = Range(0x00000000, 2 * 1024 * 1024LL);
+	const Range RAM = Range(0x00000000, 8 * 1024 * 1024LL); /* 2MB mirrored four times. */
 	const Range BIOS = Range(0x1fc00000, 512 * 1024LL);
 	const Range TIMERS = Range(0x1f801100, 0x30);
 	const Range RAM_SIZE = Range(0x1f801060, 4);
@@ -12,7 +12,8 @@ DMAController::DMAController(Bus* _bus)
 	bus = _bus;
 }
 
-void DMAController::tick()
+/* The transfer that requested the interrupt is over. */
+void DMAController::irq_event()
 {
 	if (irq_pending) {
 		irq_pending = false;
@@ -44,18 +45,24 @@ void DMAController::transfer_finished(DMAChannels dma_channel)
 void DMAController::start(DMAChannels dma_channel)
 {
 	DMAChannel& channel = channels[(uint)dma_channel];
+
+	uint words = 0;
 	if (channel.control.sync_mode == SyncType::Linked_List)
 		/* Start linked list copy routine. */
-		list_copy(dma_channel);
+		words = list_copy(dma_channel);
 	else
 		/* Start block copy routine. */
-		block_copy(dma_channel);
+		words = block_copy(dma_channel);
 
 	/* Complete the transfer. */
 	transfer_finished(dma_channel);
+
+	/* The interrupt arrives once every word was moved. */
+	if (irq_pending)
+		bus->scheduler.schedule(EventType::DMAIrq, std::max(words, 1u));
 }
 
-void DMAController::block_copy(DMAChannels dma_channel)
+uint DMAController::block_copy(DMAChannels dma_channel)
 {
 	/* Get the channel to start the transfer. */
 	DMAChannel& channel = channels[(uint)dma_channel];
@@ -95,10 +102,34 @@ void DMAController::block_copy(DMAChannels dma_channel)
 	if (sync_mode == SyncType::Request)
 		block_size *= channel.block.block_count;
 
+	uint words = block_size;
+
+	/* Range of RAM written by the transfer. */
+	uint written_start = UINT_MAX, written_end = 0;
+
 	/* Transfer the remaining blocks. */
 	while (block_size > 0) {
 		uint addr = base_addr & 0x1ffffc;
 
+		/* GPU data moves in runs of words up to the end of RAM. */
+		if (dma_channel == DMAChannels::GPU && increment == 4) {
+			uint count = std::min(block_size, (GUEST_RAM_SIZE - addr) / 4);
+			uint* data = (uint*)(bus->ram + addr);
+
+			if (trans_dir == 0) {
+				bus->gpu->get_gpuread(data, count);
+				written_start = std::min(written_start, addr);
+				written_end = std::max(written_end, addr + count * 4);
+			}
+			else {
+				bus->gpu->write_gp0(data, count);
+			}
+
+			base_addr += count * 4;
+			block_size -= count;
+			continue;
+		}
+
 		/* Select transfer source and destination. */
 		switch (trans_dir) {
 		case 0: {
@@ -120,7 +151,11 @@ void DMAController::block_copy(DMAChannels dma_channel)
 				__debugbreak();
 			}
 
-			bus->write(addr, data);
+			/* Write to RAM directly, the code cache */
+			/* is invalidated once at the end. */
+			util::write_memory(bus->ram, addr, data);
+			written_start = std::min(written_start, addr);
+			written_end = std::max(written_end, addr + 4);
 			break;
 		}
 		case 1: {
@@ -145,15 +180,21 @@ void DMAController::block_copy(DMAChannels dma_channel)
 		block_size--;
 	}
 
+	if (written_start < written_end)
+		bus->invalidate_code(written_start, written_end - written_start);
+
 	/* Complete DMA Transfer */
 	channel.control.enable = false;
 	channel.control.trigger = false;
+
+	return words;
 }
 
-void DMAController::list_copy(DMAChannels dma_channel)
+uint DMAController::list_copy(DMAChannels dma_channel)
 {
 	DMAChannel& channel = channels[(uint)dma_channel];
 	uint addr = channel.base & 0x1ffffe;
+	uint words = 0;
 
 	/* TODO: implement Device to Ram DMA transfer. */
 	if (channel.control.trans_dir == 0) {
@@ -167,21 +208,21 @@ void DMAController::list_copy(DMAChannels dma_channel)
 		ListPacket packet;
 		packet.raw = bus->read(addr);
 		uint count = packet.size;
+		words += count + 1;
 
 		/*if (count > 0)
 			printf("Packet size: %d\n", count);*/
 
-			/* Read words of the packet. */
+		/* Send the words of the packet to the GPU, */
+		/* in runs up to the end of RAM. */
 		while (count > 0) {
-			/* Point to next packet address. */
 			addr = (addr + 4) & 0x1ffffc;
 
-			/* Get command from main RAM. */
-			uint command = bus->read(addr);
+			uint run = std::min(count, (GUEST_RAM_SIZE - addr) / 4);
+			bus->gpu->write_gp0((uint*)(bus->ram + addr), run);
 
-			/* Send data to the GPU. */
-			bus->gpu->write_gp0(command);
-			count--;
+			addr += (run - 1) * 4;
+			count -= run;
 		}
 
 		/* If address is 0xffffff then we are done. */
@@ -196,6 +237,8 @@ void DMAController::list_copy(DMAChannels dma_channel)
 	/* Complete DMA Transfer */
 	channel.control.enable = false;
 	channel.control.trigger = false;
+
+	return words;
 }
 
 uint DMAController::read(uint address)
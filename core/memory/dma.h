@@ -90,13 +90,13 @@ class DMAController {
 public:
 	DMAController(Bus* bus);
 
-	void tick();
+	void irq_event();
 	bool is_channel_enabled(DMAChannels channel);
 	void transfer_finished(DMAChannels channel);
 
 	void start(DMAChannels channel);
-	void block_copy(DMAChannels channel);
-	void list_copy(DMAChannels channel);
+	uint block_copy(DMAChannels channel);
+	uint list_copy(DMAChannels channel);
 
 	uint read(uint address);
 	void write(uint address, uint data);
@@ -0,0 +1,242 @@
+#include <stdafx.hpp>
+#include "fastmem.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Physical layout of the window. */
+constexpr uint RAM_MIRRORS = 4;
+constexpr uint BIOS_START = 0x1fc00000;
+constexpr uint SCRATCHPAD_START = 0x1f800000;
+
+/* Live windows, one per Bus using fastmem. The fault */
+/* handler looks up the one containing the address. */
+constexpr uint FASTMEM_MAX_WINDOWS = 8;
+static std::atomic<Fastmem*> windows[FASTMEM_MAX_WINDOWS];
+static struct sigaction previous = {};
+static bool installed = false;
+
+/* Check if a window offset is RAM or scratchpad, */
+/* which only faults while it holds compiled code. */
+static bool is_writable(ulong offset)
+{
+	return offset < RAM_MIRRORS * GUEST_RAM_SIZE ||
+		(offset & ~0xfffULL) == SCRATCHPAD_START;
+}
+
+static Fastmem* window_of(ubyte* addr)
+{
+	for (auto& slot : windows) {
+		Fastmem* window = slot.load(std::memory_order_acquire);
+		if (window != nullptr && addr >= window->base && addr < window->base + FASTMEM_WINDOW_SIZE)
+			return window;
+	}
+
+	return nullptr;
+}
+
+static void handle_fault(int, siginfo_t* info, void* context)
+{
+	auto uc = (ucontext_t*)context;
+	auto rip = (ubyte*)uc->uc_mcontext.gregs[REG_RIP];
+	auto addr = (ubyte*)info->si_addr;
+
+	Fastmem* window = window_of(addr);
+	if (window != nullptr) {
+		auto entry = window->find_site(rip);
+		if (entry != nullptr) {
+			auto& site = *entry;
+
+			/* MMIO never becomes mapped, so send the */
+			/* access straight to the stub from now on. */
+			if (!is_writable(addr - window->base)) {
+				int disp = (int)(site.stub - (site.patch + 5));
+				site.patch[0] = 0xe9;
+				std::memcpy(site.patch + 1, &disp, 4);
+			}
+
+			uc->uc_mcontext.gregs[REG_RIP] = (greg_t)site.stub;
+			return;
+		}
+	}
+
+	/* Not a guest access, restore the previous */
+	/* handler and let the instruction fault again. */
+	sigaction(SIGSEGV, &previous, nullptr);
+	installed = false;
+}
+
+std::unique_ptr<Fastmem> Fastmem::create()
+{
+	auto fastmem = std::unique_ptr<Fastmem>(new Fastmem());
+
+	/* Guest memory lives in a shared memory file */
+	/* so it can be mapped more than once. */
+	fastmem->fd = memfd_create("psx-memory", 0);
+	if (fastmem->fd < 0 || ftruncate(fastmem->fd, GUEST_MEMORY_SIZE) != 0)
+		return nullptr;
+
+	void* memory = mmap(nullptr, GUEST_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fastmem->fd, 0);
+	if (memory == MAP_FAILED)
+		return nullptr;
+
+	fastmem->memory = (ubyte*)memory;
+
+	/* Reserve the window, everything unmapped faults. */
+	void* base = mmap(nullptr, FASTMEM_WINDOW_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+		return nullptr;
+
+	fastmem->base = (ubyte*)base;
+
+	auto map = [&](ulong addr, uint size, ulong offset, int prot) {
+		void* view = mmap(fastmem->base + addr, size, prot, MAP_SHARED | MAP_FIXED, fastmem->fd, offset);
+		return view != MAP_FAILED;
+	};
+
+	/* RAM is mirrored four times, BIOS is read only. */
+	for (uint mirror = 0; mirror < RAM_MIRRORS; mirror++) {
+		if (!map(mirror * GUEST_RAM_SIZE, GUEST_RAM_SIZE, 0, PROT_READ | PROT_WRITE))
+			return nullptr;
+	}
+
+	if (!map(BIOS_START, GUEST_BIOS_SIZE, GUEST_RAM_SIZE, PROT_READ) ||
+		!map(SCRATCHPAD_START, GUEST_SCRATCHPAD_SIZE, GUEST_RAM_SIZE + GUEST_BIOS_SIZE, PROT_READ | PROT_WRITE))
+		return nullptr;
+
+	/* Install the fault handler once. */
+	if (!installed) {
+		struct sigaction action = {};
+		action.sa_sigaction = &handle_fault;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+
+		if (sigaction(SIGSEGV, &action, &previous) != 0)
+			return nullptr;
+
+		installed = true;
+	}
+
+	for (auto& slot : windows) {
+		Fastmem* empty = nullptr;
+		if (slot.compare_exchange_strong(empty, fastmem.get()))
+			return fastmem;
+	}
+
+	/* Out of slots, the bus uses the page tables instead. */
+	return nullptr;
+}
+
+Fastmem::~Fastmem()
+{
+	for (auto& slot : windows) {
+		Fastmem* self = this;
+		slot.compare_exchange_strong(self, nullptr);
+	}
+
+	if (base != nullptr)
+		munmap(base, FASTMEM_WINDOW_SIZE);
+	if (memory != nullptr)
+		munmap(memory, GUEST_MEMORY_SIZE);
+	if (fd >= 0)
+		close(fd);
+}
+
+/* Make a physical page of RAM or scratchpad read only, */
+/* so stores to compiled code fault to the slow path. */
+void Fastmem::protect(uint abs_addr, bool protect)
+{
+	uint page = abs_addr & ~0xfffu;
+	int prot = protect ? PROT_READ : PROT_READ | PROT_WRITE;
+
+	if (page < RAM_MIRRORS * GUEST_RAM_SIZE) {
+		for (uint mirror = 0; mirror < RAM_MIRRORS; mirror++)
+			mprotect(base + mirror * GUEST_RAM_SIZE + (page % GUEST_RAM_SIZE), 4096, prot);
+	}
+	else {
+		mprotect(base + page, 4096, prot);
+	}
+}
+
+#else
+
+std::unique_ptr<Fastmem> Fastmem::create()
+{
+	return nullptr;
+}
+
+Fastmem::~Fastmem() = default;
+
+void Fastmem::protect(uint abs_addr, bool protect)
+{
+}
+
+#endif
+
+void Fastmem::add_site(FastmemSite site)
+{
+	FastmemSiteTable* table = sites.load(std::memory_order_relaxed);
+	size_t count = (table != nullptr ? table->count.load(std::memory_order_relaxed) : 0);
+
+	/* Code is emitted in order, so sites are usually appended */
+	/* past the entries the fault handler may be reading. */
+	if (table != nullptr && count < table->capacity &&
+		(count == 0 || table->entries[count - 1].access < site.access)) {
+		table->entries[count] = site;
+		table->count.store(count + 1, std::memory_order_release);
+		return;
+	}
+
+	/* Otherwise publish a sorted copy with room to grow. */
+	auto next = std::make_unique<FastmemSiteTable>();
+	next->capacity = std::max<size_t>(1024, count * 2);
+	next->entries = std::make_unique<FastmemSite[]>(next->capacity);
+
+	auto first = (table != nullptr ? table->entries.get() : nullptr);
+	auto position = std::lower_bound(first, first + count, site.access,
+		[](const FastmemSite& entry, ubyte* access) { return entry.access < access; });
+
+	size_t index = position - first;
+	bool replace = index < count && position->access == site.access;
+
+	std::copy(first, first + index, next->entries.get());
+	next->entries[index] = site;
+	std::copy(first + index + (replace ? 1 : 0), first + count, next->entries.get() + index + 1);
+	next->count = count + (replace ? 0 : 1);
+
+	sites.store(next.get(), std::memory_order_release);
+	tables.push_back(std::move(next));
+}
+
+void Fastmem::clear_sites()
+{
+	sites.store(nullptr, std::memory_order_release);
+	tables.clear();
+}
+
+/* Binary search of the published sites, safe to */
+/* call from the fault handler. */
+const FastmemSite* Fastmem::find_site(ubyte* access) const
+{
+	FastmemSiteTable* table = sites.load(std::memory_order_acquire);
+	if (table == nullptr)
+		return nullptr;
+
+	size_t low = 0, high = table->count.load(std::memory_order_acquire);
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		auto& entry = table->entries[middle];
+
+		if (entry.access == access)
+			return &entry;
+		else if (entry.access < access)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+
+/* Guest memory is one block shared by every view: */
+/* RAM, then BIOS, then the scratchpad padded to a page. */
+constexpr uint GUEST_RAM_SIZE = 2048 * 1024;
+constexpr uint GUEST_BIOS_SIZE = 512 * 1024;
+constexpr uint GUEST_SCRATCHPAD_SIZE = 4 * 1024;
+constexpr uint GUEST_MEMORY_SIZE = GUEST_RAM_SIZE + GUEST_BIOS_SIZE + GUEST_SCRATCHPAD_SIZE;
+
+/* Size of the host window covering the physical address space. */
+constexpr ulong FASTMEM_WINDOW_SIZE = 1ULL << 32;
+
+/* A recompiled access to the window. A fault on it */
+/* resumes at stub, which goes through Bus instead. */
+struct FastmemSite {
+	/* Host instruction that accesses the window. */
+	ubyte* access;
+	/* Start of the inline sequence, replaced */
+	/* with a jump to stub after an MMIO fault. */
+	ubyte* patch;
+	ubyte* stub;
+};
+
+/* Sites sorted by access. The fault handler only reads the */
+/* entries below count, which are never written again. */
+struct FastmemSiteTable {
+	std::unique_ptr<FastmemSite[]> entries;
+	size_t capacity = 0;
+	std::atomic<size_t> count{ 0 };
+};
+
+/* Maps guest memory at its physical offsets inside a 4GB */
+/* host window, so the recompiler can access it with a single */
+/* host load or store at base + (addr & region_mask). Pages */
+/* that are not mapped (MMIO) fault and are redirected to */
+/* the slow path. Only available on Linux. */
+class Fastmem {
+public:
+	~Fastmem();
+
+	/* Returns null if the host does not support it */
+	/* or too many windows are alive. */
+	static std::unique_ptr<Fastmem> create();
+
+	void protect(uint abs_addr, bool protect);
+	void add_site(FastmemSite site);
+	void clear_sites();
+	const FastmemSite* find_site(ubyte* access) const;
+
+private:
+	Fastmem() = default;
+
+public:
+	int fd = -1;
+
+	/* View of the guest memory that is always writable. */
+	ubyte* memory = nullptr;
+
+	/* Start of the physical address window. */
+	ubyte* base = nullptr;
+
+	/* Recompiled accesses. Tables replaced by a larger copy */
+	/* stay alive until the sites are cleared, in case the */
+	/* fault handler is still reading them. */
+	std::vector<std::unique_ptr<FastmemSiteTable>> tables;
+	std::atomic<FastmemSiteTable*> sites{ nullptr };
+};
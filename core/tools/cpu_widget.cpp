@@ -3,6 +3,7 @@
 #include "debugger.hpp"
 #include <memory/bus.h>
 #include <cpu/cpu.h>
+#include <tools/profiler.h>
 
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include <imgui.h>
@@ -19,6 +20,10 @@ void CPUWidget::execute()
 
     if (ImGui::Button("Trace")) {
         cpu->should_log = !cpu->should_log;
+
+        /* Flush the trace once it is turned off. */
+        if (!cpu->should_log)
+            cpu->tracer.close();
     }
     ImGui::SameLine();
 
@@ -47,6 +52,46 @@ void CPUWidget::execute()
     ImGui::PopStyleColor(3);
     ImGui::PopID();
 
+    /* Guest PC sampling profiler. */
+    auto& profiler = debugger->bus->profiler;
+
+    if (ImGui::Button(profiler->running ? "Stop Profile" : "Profile")) {
+        if (profiler->running)
+            profiler->stop();
+        else
+            profiler->start(profiler->interval);
+    }
+    ImGui::SameLine();
+
+    if (ImGui::Button("Export Profile")) {
+        profiler->write_report("profile.txt");
+        profiler->write_folded("profile.folded");
+    }
+    ImGui::SameLine();
+
+    if (ImGui::Button("Clear Profile")) {
+        profiler->clear();
+    }
+
+    ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.5f);
+    ImGui::InputScalar("Sample cycles", ImGuiDataType_U32, &profiler->interval);
+    ImGui::PopItemWidth();
+
+    /* Select the execution backend. */
+    const char* modes[] = { "Interpreter", "Cached Interpreter", "Recompiler" };
+    int current_mode = (int)cpu->mode;
+
+    ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.5f);
+    if (ImGui::Combo("Backend", &current_mode, modes, IM_ARRAYSIZE(modes))) {
+        cpu->set_mode((CPUMode)current_mode);
+    }
+    ImGui::PopItemWidth();
+
+    /* Idle loops are only detected by the block based backends. */
+    ImGui::Checkbox("Skip idle loops", &cpu->idle_skip);
+    ImGui::Text("Skipped: %llu cycles in %llu loops", (unsigned long long)cpu->idle_cycles,
+        (unsigned long long)cpu->idle_skips);
+
     ImGui::Text("Program Counter");
     ImGui::Separator();
 
@@ -1,7 +1,7 @@
 #include <stdafx.hpp>
 #include "debugger.hpp"
 #include <memory/bus.h>
-#include <video/renderer.h>
+#include <GLFW/glfw3.h>
 #include "imgui_header.hpp"
 
 Debugger::Debugger(Bus* _bus) :
@@ -27,7 +27,7 @@ Debugger::Debugger(Bus* _bus) :
 
     const char* glsl_version = "#version 330";
 
-    ImGui_ImplGlfw_InitForOpenGL(bus->renderer->window, true);
+    ImGui_ImplGlfw_InitForOpenGL(bus->window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
     io.Fonts->AddFontFromFileTTF("data/fonts/Roboto-Bold.ttf", 20.0f);
@@ -2,6 +2,7 @@
 #include <vector>
 #include "cpu_widget.hpp"
 #include "mem_widget.hpp"
+#include "kernel_widget.hpp"
 
 class Bus;
 class Debugger {
@@ -9,6 +10,7 @@ public:
 	friend class CPUWidget;
 	friend class MemWidget;
 	friend class GPUWidget;
+	friend class KernelWidget;
 
 public:
 	Debugger(Bus* _bus);
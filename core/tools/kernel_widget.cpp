@@ -0,0 +1,82 @@
+#include "stdafx.hpp"
+#include "kernel_widget.hpp"
+#include "debugger.hpp"
+#include <memory/bus.h>
+#include <cpu/cpu.h>
+#include <imgui.h>
+
+void KernelWidget::execute()
+{
+	auto& kernel_calls = debugger->bus->cpu->kernel_calls;
+	static const char* tables[] = { "A0", "B0", "C0" };
+
+	ImGui::Begin(name.c_str());
+	ImGui::Checkbox("Trace kernel calls", &kernel_calls.enabled);
+	ImGui::SameLine();
+
+	if (ImGui::Button("Clear"))
+		kernel_calls.clear();
+
+	ImGui::SameLine();
+
+	if (ImGui::Button("Dump JSON"))
+		kernel_calls.write_json("kernel_calls.json");
+
+	/* Native implementations, each can be turned off. */
+	auto& kernel_hle = debugger->bus->cpu->kernel_hle;
+	ImGui::Checkbox("High-level emulation", &kernel_hle.enabled);
+	ImGui::SameLine();
+	ImGui::Text("%llu native calls", (unsigned long long)kernel_hle.calls);
+
+	if (ImGui::TreeNode("HLE functions")) {
+		for (uint table = 0; table < (uint)KernelTable::Count; table++) {
+			for (uint function = 0; function < 256; function++) {
+				if (!kernel_hle.supported((KernelTable)table, function))
+					continue;
+
+				char label[64];
+				std::snprintf(label, sizeof(label), "%s:%02x %s", tables[table], function,
+					KernelCallTracer::name((KernelTable)table, function));
+				ImGui::Checkbox(label, &kernel_hle.functions[table][function]);
+			}
+		}
+
+		ImGui::TreePop();
+	}
+
+	/* Called functions, most expensive first. */
+
+	std::vector<std::pair<uint, uint>> called;
+	for (uint table = 0; table < (uint)KernelTable::Count; table++) {
+		for (uint function = 0; function < 256; function++) {
+			if (kernel_calls.stats[table][function].calls != 0)
+				called.emplace_back(table, function);
+		}
+	}
+
+	std::sort(called.begin(), called.end(), [&](auto& a, auto& b) {
+		return kernel_calls.stats[a.first][a.second].cycles > kernel_calls.stats[b.first][b.second].cycles;
+	});
+
+	ImGui::Separator();
+	ImGui::Columns(4, "kernel_calls");
+	ImGui::Text("Function"); ImGui::NextColumn();
+	ImGui::Text("Calls"); ImGui::NextColumn();
+	ImGui::Text("Cycles"); ImGui::NextColumn();
+	ImGui::Text("Last arguments"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (auto& [table, function] : called) {
+		auto& entry = kernel_calls.stats[table][function];
+		const char* known = KernelCallTracer::name((KernelTable)table, function);
+
+		ImGui::Text("%s:%02x %s", tables[table], function, (known != nullptr ? known : "")); ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)entry.calls); ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)entry.cycles); ImGui::NextColumn();
+		ImGui::Text("%08x %08x %08x %08x", entry.args[0], entry.args[1], entry.args[2], entry.args[3]);
+		ImGui::NextColumn();
+	}
+
+	ImGui::Columns();
+	ImGui::End();
+}
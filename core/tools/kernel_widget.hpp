@@ -0,0 +1,15 @@
+#pragma once
+#include "widget.hpp"
+
+class Debugger;
+class KernelWidget : public Widget {
+public:
+	KernelWidget(Debugger* _debugger) :
+		Widget("Kernel Calls"), debugger(_debugger) {}
+	~KernelWidget() = default;
+
+	void execute() override;
+
+private:
+	Debugger* debugger;
+};
@@ -0,0 +1,268 @@
+#include <stdafx.hpp>
+#include "lockstep.h"
+#include <cpu/disassembler.h>
+
+/* Give up if the BIOS does not reach the shell by then. */
+constexpr ulong LOCKSTEP_BOOT_CYCLES = 1ULL << 32;
+
+Lockstep::Lockstep(const std::string& bios_path, CPUMode mode) :
+	bios_path(bios_path), mode(mode)
+{
+}
+
+bool Lockstep::run(const std::string& exe_path, ulong cycles)
+{
+	/* Fresh machines for every program. The fast backend */
+	/* gets the fastmem window, the reference uses the tables. */
+	test.reset();
+	reference.reset();
+
+	reference = std::make_unique<Bus>(bios_path, false, RendererType::Null);
+	test = std::make_unique<Bus>(bios_path, true, RendererType::Null);
+	test->cpu->set_mode(mode);
+
+	blocks = 0;
+	mismatch = false;
+
+	bool loaded = false;
+	ulong end = LOCKSTEP_BOOT_CYCLES;
+
+	while (reference->cpu->cycles < end) {
+		/* Both CPUs are at the same PC between blocks. */
+		if (!loaded && reference->cpu->pc == SHELL_ENTRY) {
+			if (!sideload(reference.get(), exe_path) || !sideload(test.get(), exe_path)) {
+				std::printf("%s: cannot load the program\n", exe_path.c_str());
+				return false;
+			}
+
+			loaded = true;
+			end = reference->cpu->cycles + cycles;
+		}
+
+		if (!step())
+			return false;
+
+		if (blocks % LOCKSTEP_HASH_INTERVAL == 0 && !compare_ram())
+			return false;
+	}
+
+	if (!compare_ram())
+		return false;
+
+	if (!loaded) {
+		std::printf("%s: the BIOS did not reach the shell\n", exe_path.c_str());
+		return false;
+	}
+
+	std::printf("%s: ok, %llu blocks\n", exe_path.c_str(), (unsigned long long)blocks);
+	return true;
+}
+
+/* Run one block on the fast backend and the same */
+/* instructions on the reference, then compare them. */
+bool Lockstep::step()
+{
+	CPU* ref = reference->cpu.get();
+	CPU* cpu = test->cpu.get();
+
+	/* Like the run loops, take a pending interrupt first. */
+	if (ref->irq_pending)
+		ref->handle_interrupts();
+
+	block_pc = ref->pc;
+	block_size = cpu->run(1);
+
+	stores.clear();
+	for (uint i = 0; i < block_size; i++) {
+		/* Remember the RAM words the instruction stores to. */
+		/* The address is taken before it can change its base. */
+		if ((ref->pc & 0x3) == 0) {
+			Instr instr;
+			instr.value = reference->read(ref->pc);
+
+			uint opcode = instr.opcode();
+			if ((opcode >= 0x28 && opcode <= 0x2e) || opcode == 0x3a) {
+				uint addr = reference->physical_addr(ref->registers[instr.rs()] + instr.imm_s());
+				if (addr < 4 * GUEST_RAM_SIZE)
+					stores.push_back(addr & (GUEST_RAM_SIZE - 4));
+			}
+		}
+
+		ref->tick();
+	}
+
+	blocks++;
+	if (!compare())
+		return false;
+
+	/* Both sides are at the same cycle, so the */
+	/* same events are due on both. */
+	reference->handle_events();
+	test->handle_events();
+
+	return true;
+}
+
+/* Print the block on the first mismatch, then every difference. */
+void Lockstep::report(const char* what, uint expected, uint actual)
+{
+	if (!mismatch) {
+		std::printf("mismatch after block %llu at %08x (%u instructions):\n",
+			(unsigned long long)blocks, block_pc, block_size);
+
+		for (uint i = 0; i < block_size; i++) {
+			uint addr = block_pc + i * 4;
+
+			Instr instr;
+			instr.value = reference->read(addr);
+			std::printf("  %08x: %08x  %s\n", addr, instr.value, disassemble(instr, addr).c_str());
+		}
+
+		std::printf("  %-10s %-10s %s\n", "", "reference", "test");
+		mismatch = true;
+	}
+
+	std::printf("  %-10s %08x   %08x\n", what, expected, actual);
+}
+
+bool Lockstep::compare()
+{
+	CPU* ref = reference->cpu.get();
+	CPU* cpu = test->cpu.get();
+
+	auto check = [&](const char* what, uint expected, uint actual) {
+		if (expected != actual)
+			report(what, expected, actual);
+	};
+
+	check("pc", ref->pc, cpu->pc);
+	check("next_pc", ref->next_pc, cpu->next_pc);
+	check("hi", ref->hi, cpu->hi);
+	check("lo", ref->lo, cpu->lo);
+	check("cycles", (uint)ref->cycles, (uint)cpu->cycles);
+
+	char name[16];
+	for (uint i = 1; i < 32; i++) {
+		std::snprintf(name, sizeof(name), "r%u", i);
+		check(name, ref->registers[i], cpu->registers[i]);
+	}
+
+	check("sr", ref->cop0.sr.raw, cpu->cop0.sr.raw);
+	check("cause", ref->cop0.cause.raw, cpu->cop0.cause.raw);
+	check("epc", ref->cop0.epc, cpu->cop0.epc);
+	check("bada", ref->cop0.BadA, cpu->cop0.BadA);
+	check("tar", ref->cop0.TAR, cpu->cop0.TAR);
+
+	for (uint i = 0; i < 32; i++) {
+		std::snprintf(name, sizeof(name), "gte d%u", i);
+		check(name, ref->gte.read_data(i), cpu->gte.read_data(i));
+		std::snprintf(name, sizeof(name), "gte c%u", i);
+		check(name, ref->gte.read_control(i), cpu->gte.read_control(i));
+	}
+
+	for (uint addr : stores) {
+		uint expected, actual;
+		std::memcpy(&expected, reference->ram + addr, 4);
+		std::memcpy(&actual, test->ram + addr, 4);
+
+		std::snprintf(name, sizeof(name), "[%08x]", addr);
+		check(name, expected, actual);
+	}
+
+	for (uint offset = 0; offset < GUEST_SCRATCHPAD_SIZE; offset += 4) {
+		uint expected, actual;
+		std::memcpy(&expected, reference->scratchpad + offset, 4);
+		std::memcpy(&actual, test->scratchpad + offset, 4);
+
+		std::snprintf(name, sizeof(name), "[%08x]", 0x1f800000 + offset);
+		check(name, expected, actual);
+	}
+
+	return !mismatch;
+}
+
+static ulong hash_memory(const ubyte* data, size_t size)
+{
+	/* FNV-1a over 64-bit words. */
+	ulong hash = 0xcbf29ce484222325ULL;
+	for (size_t offset = 0; offset < size; offset += 8) {
+		ulong word;
+		std::memcpy(&word, data + offset, 8);
+		hash = (hash ^ word) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/* Catches RAM changes the store tracking cannot see, like DMA. */
+bool Lockstep::compare_ram()
+{
+	if (hash_memory(reference->ram, GUEST_RAM_SIZE) == hash_memory(test->ram, GUEST_RAM_SIZE))
+		return true;
+
+	std::printf("RAM differs within the last %u blocks (block %llu):\n",
+		LOCKSTEP_HASH_INTERVAL, (unsigned long long)blocks);
+
+	for (uint offset = 0; offset < GUEST_RAM_SIZE; offset += 4) {
+		uint expected, actual;
+		std::memcpy(&expected, reference->ram + offset, 4);
+		std::memcpy(&actual, test->ram + offset, 4);
+
+		if (expected != actual) {
+			std::printf("  [%08x] %08x   %08x\n", offset, expected, actual);
+			break;
+		}
+	}
+
+	return false;
+}
+
+/* Load a program like the shell would have. */
+bool Lockstep::sideload(Bus* bus, const std::string& exe_path)
+{
+	PSEXELoadInfo info;
+	if (!bus->loadEXE(exe_path, info))
+		return false;
+
+	bus->cpu->sideload(info);
+	return true;
+}
+
+int run_lockstep(int argc, char** argv)
+{
+	std::string bios_path = "./bios/SCPH1001.BIN";
+	CPUMode mode = CPUMode::Recompiler;
+	ulong cycles = 33868800ULL * 10;
+
+	std::vector<std::string> programs;
+	for (int i = 0; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--bios" && i + 1 < argc)
+			bios_path = argv[++i];
+		else if (arg == "--cycles" && i + 1 < argc)
+			cycles = std::stoull(argv[++i]);
+		else if (arg == "--cached")
+			mode = CPUMode::CachedInterpreter;
+		else if (arg == "--jit")
+			mode = CPUMode::Recompiler;
+		else
+			programs.push_back(arg);
+	}
+
+	if (programs.empty()) {
+		std::printf("usage: --lockstep [--cached | --jit] [--bios path] [--cycles n] program.exe...\n");
+		return 2;
+	}
+
+	Lockstep lockstep(bios_path, mode);
+
+	uint failed = 0;
+	for (auto& program : programs) {
+		if (!lockstep.run(program, cycles))
+			failed++;
+	}
+
+	std::printf("%zu programs, %u failed\n", programs.size(), failed);
+	return failed != 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cpu/cpu.h>
+
+/* Number of blocks between two full RAM hash checks. */
+constexpr uint LOCKSTEP_HASH_INTERVAL = 16384;
+
+/* Runs a fast CPU backend and the reference interpreter side by */
+/* side on two headless buses. After every block of the fast */
+/* backend the reference executes the same number of instructions */
+/* and the CPU state, GTE registers, scratchpad and the RAM words */
+/* the block stored to are compared. The whole of RAM is compared */
+/* through a hash every LOCKSTEP_HASH_INTERVAL blocks. */
+/* NOTE: VRAM is global and shared by both buses, it is not compared. */
+class Lockstep {
+public:
+	Lockstep(const std::string& bios_path, CPUMode mode);
+	~Lockstep() = default;
+
+	/* Boot the BIOS, sideload the program and run it for */
+	/* the given number of cycles. Returns false on a mismatch. */
+	bool run(const std::string& exe_path, ulong cycles);
+
+private:
+	bool step();
+	bool compare();
+	bool compare_ram();
+	bool sideload(Bus* bus, const std::string& exe_path);
+	void report(const char* what, uint expected, uint actual);
+
+public:
+	std::string bios_path;
+	CPUMode mode;
+
+	std::unique_ptr<Bus> reference, test;
+
+	/* The block that ran last. */
+	uint block_pc = 0, block_size = 0;
+	ulong blocks = 0;
+
+	/* RAM words the reference stored to during the block. */
+	std::vector<uint> stores;
+	bool mismatch = false;
+};
+
+/* Entry point of the --lockstep command line mode. */
+int run_lockstep(int argc, char** argv);
@@ -0,0 +1,210 @@
+#include <stdafx.hpp>
+#include "profiler.h"
+#include <memory/bus.h>
+#include <cpu/cpu.h>
+
+/* Number of entries listed in each report section. */
+constexpr uint PROFILER_REPORT_ENTRIES = 50;
+
+Profiler::Profiler(Bus* bus) :
+	bus(bus)
+{
+}
+
+void Profiler::start(uint sample_interval)
+{
+	interval = std::max<uint>(sample_interval, 1);
+	last_sample = bus->scheduler.now();
+	running = true;
+
+	bus->scheduler.schedule(EventType::ProfilerSample, interval);
+}
+
+void Profiler::stop()
+{
+	bus->scheduler.cancel(EventType::ProfilerSample);
+	running = false;
+}
+
+void Profiler::clear()
+{
+	samples.clear();
+	total = 0;
+	last_sample = bus->scheduler.now();
+}
+
+void Profiler::sample()
+{
+	CPU* cpu = bus->cpu.get();
+
+	/* Charge the elapsed cycles to the last executed instruction. */
+	ulong now = bus->scheduler.now();
+	ulong key = ((ulong)cpu->registers[31] << 32) | cpu->current_pc;
+
+	samples[key] += now - last_sample;
+	total += now - last_sample;
+	last_sample = now;
+
+	bus->scheduler.schedule(EventType::ProfilerSample, interval);
+}
+
+/* Read code without going through MMIO. */
+uint Profiler::read_code(uint addr)
+{
+	uint physical = bus->physical_addr(addr) & ~0x3u;
+	const ubyte* host = nullptr;
+
+	if (physical < 4 * GUEST_RAM_SIZE)
+		host = bus->ram + (physical & (GUEST_RAM_SIZE - 1));
+	else if (physical >= 0x1fc00000 && physical < 0x1fc00000 + GUEST_BIOS_SIZE)
+		host = bus->bios + (physical - 0x1fc00000);
+	else
+		return 0;
+
+	uint value;
+	std::memcpy(&value, host, 4);
+	return value;
+}
+
+/* Every JAL target in RAM and the BIOS starts a function. */
+/* They are kept as physical addresses, so code run through */
+/* KUSEG, KSEG0 or KSEG1 resolves to the same functions. */
+void Profiler::find_functions()
+{
+	functions.clear();
+
+	auto scan = [&](const ubyte* memory, uint size, uint base) {
+		for (uint offset = 0; offset < size; offset += 4) {
+			Instr instr;
+			std::memcpy(&instr.value, memory + offset, 4);
+
+			if (instr.opcode() == 0b000011) {
+				uint next = base + offset + 4;
+				uint target = (next & 0xf0000000) | (instr.addr() << 2);
+				functions.push_back(target & 0x1fffffff);
+			}
+		}
+	};
+
+	scan(bus->ram, GUEST_RAM_SIZE, 0x80000000);
+	scan(bus->bios, GUEST_BIOS_SIZE, 0xbfc00000);
+
+	std::sort(functions.begin(), functions.end());
+	functions.erase(std::unique(functions.begin(), functions.end()), functions.end());
+}
+
+uint Profiler::function_of(uint pc)
+{
+	auto entry = std::upper_bound(functions.begin(), functions.end(), pc & 0x1fffffff);
+	return (entry == functions.begin() ? 0 : *(entry - 1));
+}
+
+/* Walk back to the instruction after the previous delay slot */
+/* or to the start of the function, whichever comes first. */
+uint Profiler::block_of(uint pc)
+{
+	uint start = pc & 0x1ffffffc;
+	for (uint i = 0; i < MAX_BLOCK_SIZE; i++) {
+		if (std::binary_search(functions.begin(), functions.end(), start))
+			break;
+
+		Instr instr;
+		instr.value = read_code(start - 8);
+		if (BlockCache::is_jump(instr))
+			break;
+
+		start -= 4;
+	}
+
+	return start;
+}
+
+std::string Profiler::symbol(uint addr)
+{
+	char name[32];
+	if (addr == 0)
+		std::snprintf(name, sizeof(name), "unknown");
+	else
+		std::snprintf(name, sizeof(name), "fn_%08x", addr);
+
+	return name;
+}
+
+bool Profiler::write_report(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	find_functions();
+
+	std::unordered_map<uint, ulong> by_function, by_block;
+	for (auto& [key, cycles] : samples) {
+		uint pc = (uint)key;
+		by_function[function_of(pc)] += cycles;
+		by_block[block_of(pc)] += cycles;
+	}
+
+	auto sorted = [](const std::unordered_map<uint, ulong>& map) {
+		std::vector<std::pair<uint, ulong>> entries(map.begin(), map.end());
+		std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.second > b.second; });
+		return entries;
+	};
+
+	double scale = (total != 0 ? 100.0 / total : 0.0);
+	std::fprintf(file, "%llu cycles sampled every %u cycles\n", (unsigned long long)total, interval);
+
+	std::fprintf(file, "\nFunctions:\n");
+	auto functions_sorted = sorted(by_function);
+	for (size_t i = 0; i < functions_sorted.size() && i < PROFILER_REPORT_ENTRIES; i++) {
+		auto& [addr, cycles] = functions_sorted[i];
+		std::fprintf(file, "  %6.2f%%  %12llu  %s\n", cycles * scale,
+			(unsigned long long)cycles, symbol(addr).c_str());
+	}
+
+	std::fprintf(file, "\nBlocks:\n");
+	auto blocks_sorted = sorted(by_block);
+	for (size_t i = 0; i < blocks_sorted.size() && i < PROFILER_REPORT_ENTRIES; i++) {
+		auto& [addr, cycles] = blocks_sorted[i];
+		uint function = function_of(addr);
+
+		std::fprintf(file, "  %6.2f%%  %12llu  %08x  %s+0x%x\n", cycles * scale,
+			(unsigned long long)cycles, addr, symbol(function).c_str(), addr - function);
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+bool Profiler::write_folded(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	find_functions();
+
+	/* The return address gives one level of caller, */
+	/* the function of the JAL that set it. */
+	std::unordered_map<std::string, ulong> stacks;
+	for (auto& [key, cycles] : samples) {
+		uint pc = (uint)key;
+		uint ra = (uint)(key >> 32);
+
+		char block[16];
+		std::snprintf(block, sizeof(block), "%08x", block_of(pc));
+
+		std::string stack;
+		if (ra >= 8)
+			stack = symbol(function_of(ra - 8)) + ";";
+
+		stack += symbol(function_of(pc)) + ";" + block;
+		stacks[stack] += cycles;
+	}
+
+	for (auto& [stack, cycles] : stacks)
+		std::fprintf(file, "%s %llu\n", stack.c_str(), (unsigned long long)cycles);
+
+	std::fclose(file);
+	return true;
+}
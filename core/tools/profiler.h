@@ -0,0 +1,54 @@
+#pragma once
+#include <utility/types.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Default sampling interval, about 10KHz of guest time. */
+constexpr uint PROFILER_DEFAULT_INTERVAL = 3386;
+
+class Bus;
+
+/* Samples the guest PC and return address from a scheduler */
+/* event, so nothing runs while it is stopped. Each sample is */
+/* weighted by the cycles since the previous one, which keeps */
+/* skipped idle loops accounted for. Blocks and functions are */
+/* only resolved when a report is written: a function starts */
+/* at a JAL target and a block after a branch delay slot. */
+class Profiler {
+public:
+	Profiler(Bus* bus);
+	~Profiler() = default;
+
+	void start(uint interval);
+	void stop();
+	void clear();
+	void sample();
+
+	/* Hot functions and blocks, sorted by cycles. */
+	bool write_report(const std::string& path);
+
+	/* caller;function;block lines for flamegraph tools. */
+	bool write_folded(const std::string& path);
+
+private:
+	uint read_code(uint addr);
+	void find_functions();
+	uint function_of(uint pc);
+	uint block_of(uint pc);
+	std::string symbol(uint addr);
+
+public:
+	Bus* bus;
+	bool running = false;
+	uint interval = PROFILER_DEFAULT_INTERVAL;
+
+	/* Cycles spent, keyed by PC in the low and RA in the high half. */
+	std::unordered_map<ulong, ulong> samples;
+	ulong total = 0;
+	ulong last_sample = 0;
+
+private:
+	/* Sorted JAL targets, rebuilt for every report. */
+	std::vector<uint> functions;
+};
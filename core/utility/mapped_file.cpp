@@ -0,0 +1,108 @@
+#include <stdafx.hpp>
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+
+	data = (const ubyte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		close();
+		return false;
+	}
+
+	size = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+
+	data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	/* Empty files cannot be mapped. */
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	/* The mapping stays valid after the descriptor is closed. */
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (view == MAP_FAILED)
+		return false;
+
+	data = (const ubyte*)view;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data != nullptr)
+		munmap((void*)data, size);
+
+	data = nullptr;
+	size = 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <utility/types.hpp>
+
+/* A read only memory mapping of a whole file. */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool is_open() const { return data != nullptr; }
+
+public:
+	const ubyte* data = nullptr;
+	size_t size = 0;
+
+private:
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
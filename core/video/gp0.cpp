@@ -30,11 +30,7 @@ int GPU::command_size[16 * 16] =
 void GPU::write_gp0(uint data) {
     /* If a transfer is pending ignore command. */
     if (cpu_to_gpu.active) {
-        auto lower = ushort(data >> 0);
-        auto upper = ushort(data >> 16);
-
-        vram_transfer(lower);
-        vram_transfer(upper);
+        vram_transfer((const ushort*)&data, 2);
         return;
     }
 
@@ -42,8 +38,17 @@ void GPU::write_gp0(uint data) {
     fifo.push_back(data);
     uint command = fifo[0] >> 24;
 
+    /* Polylines run until a terminator word after their second */
+    /* point instead of having a fixed size. */
+    bool polyline = (command >= 0x48 && command <= 0x4F) || (command >= 0x58 && command <= 0x5F);
+    bool complete = fifo.size() == command_size[command];
+    if (polyline) {
+        size_t first_end = (command >= 0x58 ? 5 : 4);
+        complete = fifo.size() >= first_end && (data & 0xF000F000) == 0x50005000;
+    }
+
     /* If the command is complete, execute it. */
-    if (fifo.size() == command_size[command]) {
+    if (complete) {
         if (command == 0x00) {
             gp0_nop();
             current_command = GPUCommand::Nop;
@@ -61,6 +66,7 @@ void GPU::write_gp0(uint data) {
             current_command = GPUCommand::Polygon;
         }
         else if (command >= 0x40 && command <= 0x5F) {
+            gp0_render_line();
             current_command = GPUCommand::Line;
         }
         else if (command >= 0x60 && command <= 0x7F) {
@@ -113,10 +119,26 @@ void GPU::write_gp0(uint data) {
     }
 }
 
+void GPU::write_gp0(const uint* data, uint count)
+{
+    while (count > 0) {
+        if (!cpu_to_gpu.active) {
+            write_gp0(*data++);
+            count--;
+            continue;
+        }
+
+        /* Image data goes to VRAM a row at a time. The unused */
+        /* half of an odd sized transfer's last word is dropped. */
+        uint words = (vram_transfer((const ushort*)data, count * 2) + 1) / 2;
+        data += words;
+        count -= words;
+    }
+}
+
 /* Renders a polygon to the framebuffer. */
 void GPU::gp0_render_polygon()
 {
-    auto& shader = gl_renderer->shader;
     auto command = fifo[0];
     auto opcode = command >> 24;
 
@@ -147,6 +169,13 @@ void GPU::gp0_render_polygon()
 
         clut_coord = glm::vec2(cx, cy);
         texpage = glm::vec2(tx, ty);
+
+        /* The texpage attribute also sets the GP0(E1h) bits */
+        /* that it has, later rectangles draw with them too. */
+        status.page_base_x = page.page_x;
+        status.page_base_y = page.page_y;
+        status.semi_transprency = page.semi_transp;
+        status.texture_depth = page.page_colors;
     }
 
     int color_depth = depth[page.page_colors];
@@ -178,7 +207,7 @@ void GPU::gp0_render_polygon()
     
     if (quad) vdata.insert(vdata.end(), { vdata[1], vdata[2] });
 
-    gl_renderer->draw_call(vdata, Primitive::Polygon);
+    renderer->draw_call(vdata, Primitive::Polygon, command);
     vdata.clear();
 }
 
@@ -267,7 +296,44 @@ void GPU::gp0_render_rect()
     vdata.insert(vdata.end(), { vdata[1], vdata[2] });
 
     /* Batch the draw data/ */
-    gl_renderer->draw_call(vdata, Primitive::Rectangle);
+    renderer->draw_call(vdata, Primitive::Rectangle, command);
+    vdata.clear();
+}
+
+/* Renders a line or a polyline to the framebuffer. */
+void GPU::gp0_render_line()
+{
+    auto command = fifo[0];
+
+    bool shaded = util::get_bit(command, 28);
+    bool polyline = util::get_bit(command, 27);
+
+    /* Skip the terminator word of polylines. */
+    size_t end = fifo.size() - (polyline ? 1 : 0);
+    std::vector<Vertex> points;
+
+    /* Mono lines take their color from the command word, */
+    /* shaded ones have a color word before every point */
+    /* but the first. */
+    for (size_t pointer = 1; pointer < end;) {
+        uint color = fifo[0];
+        if (shaded && !points.empty())
+            color = fifo[pointer++];
+
+        if (pointer >= end)
+            break;
+
+        Vertex v = {};
+        v.color = unpack_color(color);
+        v.pos = unpack_point(fifo[pointer++]) + glm::ivec2(draw_offset);
+        points.push_back(v);
+    }
+
+    /* Split into segments. */
+    for (size_t i = 0; i + 1 < points.size(); i++)
+        vdata.insert(vdata.end(), { points[i], points[i + 1] });
+
+    renderer->draw_call(vdata, Primitive::Line, command);
     vdata.clear();
 }
 
@@ -287,8 +353,10 @@ Fill is NOT affected by the Mask settings (acts as if Mask.Bit0,1 are both zero)
 void GPU::gp0_fill_rect()
 {
     auto color = unpack_color(fifo[0]);
-    auto top_left = unpack_point(fifo[1]);
-    auto size = unpack_point(fifo[2]);
+
+    /* Apply the 16 halfword masking and rounding. */
+    auto top_left = glm::ivec2(fifo[1] & 0x3F0, (fifo[1] >> 16) & 0x1FF);
+    auto size = glm::ivec2(((fifo[2] & 0x3FF) + 0xF) & ~0xF, (fifo[2] >> 16) & 0x1FF);
 
     glm::ivec2 points[4] =
     {
@@ -314,7 +382,7 @@ void GPU::gp0_fill_rect()
     /* Force draw. */
     /* NOTE: this done as fill commands ignore all */
     /* mask settings that the batch renderer uses. */
-    gl_renderer->draw(vdata);
+    renderer->draw(vdata);
     vdata.clear();
 }
 
@@ -424,11 +492,14 @@ Transfers data from CPU to frame buffer.
 The transfer is affected by Mask setting.*/
 void GPU::gp0_image_load()
 {
+    renderer->sync();
+
     auto& transfer = cpu_to_gpu;
-    transfer.start_x = fifo[1] & 0xffff;
-    transfer.start_y = fifo[1] >> 16;
-    transfer.width = fifo[2] & 0xffff;
-    transfer.height = fifo[2] >> 16;
+    transfer.start_x = fifo[1] & 0x3ff;
+    transfer.start_y = (fifo[1] >> 16) & 0x1ff;
+    /* Sizes of zero mean the full width or height of VRAM. */
+    transfer.width = ((fifo[2] & 0xffff) - 1) % VRAM_WIDTH + 1;
+    transfer.height = ((fifo[2] >> 16) - 1) % VRAM_HEIGHT + 1;
 
     transfer.pos_x = 0;
     transfer.pos_y = 0;
@@ -443,11 +514,13 @@ void GPU::gp0_image_load()
 Copys data within framebuffer. The transfer is affected by Mask setting.*/
 void GPU::gp0_image_store()
 {
+    renderer->sync();
+
     auto& transfer = gpu_to_cpu;
-    transfer.start_x = fifo[1] & 0xffff;
-    transfer.start_y = fifo[1] >> 16;
-    transfer.width = fifo[2] & 0xffff;
-    transfer.height = fifo[2] >> 16;
+    transfer.start_x = fifo[1] & 0x3ff;
+    transfer.start_y = (fifo[1] >> 16) & 0x1ff;
+    transfer.width = ((fifo[2] & 0xffff) - 1) % VRAM_WIDTH + 1;
+    transfer.height = ((fifo[2] >> 16) - 1) % VRAM_HEIGHT + 1;
 
     transfer.pos_x = 0;
     transfer.pos_y = 0;
@@ -462,21 +535,14 @@ void GPU::gp0_image_store()
 Copys data within framebuffer. The transfer is affected by Mask setting.*/
 void GPU::gp0_image_transfer()
 {
-    auto src = unpack_point(fifo[1]);
-    auto dest = unpack_point(fifo[2]);
-    auto size = unpack_point(fifo[3]);
-
-    for (int y = 0; y < size.y; y++) {
-        for (int x = 0; x < size.x; x++) {
-            int sx = (src.x + x) % 1024;
-            int sy = (src.y + y) % 512;
-            auto data = vram.read(sx, sy);
-
-            int dx = (dest.x + x) % 1024;
-            int dy = (dest.y + y) % 512;
-            vram.write(dx, dy, data);
-        }
-    }
+    uint src_x = fifo[1] & 0x3ff, src_y = (fifo[1] >> 16) & 0x1ff;
+    uint dest_x = fifo[2] & 0x3ff, dest_y = (fifo[2] >> 16) & 0x1ff;
+    uint width = ((fifo[3] & 0xffff) - 1) % VRAM_WIDTH + 1;
+    uint height = ((fifo[3] >> 16) - 1) % VRAM_HEIGHT + 1;
+
+    renderer->sync();
+    vram.copy_rect(src_x, src_y, dest_x, dest_y, width, height,
+        status.force_set_mask_bit, status.preserve_masked_pixels);
 
-    vram.upload_to_gpu();
+    renderer->upload_vram();
 }
\ No newline at end of file
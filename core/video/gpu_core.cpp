@@ -2,10 +2,11 @@
 #include "gpu_core.h"
 #include <memory/bus.h>
 #include <video/vram.h>
+#include <video/renderer.h>
 #include <glad/glad.h>
 
 GPU::GPU(Renderer* renderer) :
-    gl_renderer(renderer)
+    renderer(renderer)
 {
     status.value = 0x14802000;
 
@@ -79,13 +80,16 @@ glm::ivec3 GPU::unpack_color(uint color)
 
 uint GPU::get_gpuread() 
 {
-    if (gpu_to_cpu.active) {
-        auto lower = vram_transfer();
-        auto upper = vram_transfer();
-        return (upper << 16) | lower;
-    }
+    uint data = 0;
+    get_gpuread(&data, 1);
+    return data;
+}
 
-    return 0;
+void GPU::get_gpuread(uint* data, uint count)
+{
+    /* Halfwords past the end of the transfer read as zero. */
+    uint moved = vram_transfer((ushort*)data, count * 2);
+    std::fill((ushort*)data + moved, (ushort*)(data + count), 0);
 }
 
 uint GPU::get_gpustat() 
@@ -145,54 +149,76 @@ bool GPU::tick(uint cycles)
                 status.odd_lines = !status.odd_lines;
 
             in_vblank = true;
+            frame_count++;
         }
     }
 
     return in_vblank;
 }
 
-ushort GPU::vram_transfer() 
+/* CPU cycles until tick finishes the current scanline. */
+uint GPU::cycles_until_scanline()
 {
-    auto& transfer = gpu_to_cpu;
-    if (!transfer.active)
-        return 0;
-
-    auto data = vram.read(transfer.start_x + transfer.pos_x,
-        transfer.start_y + transfer.pos_y);
-
-    transfer.pos_x++;
-    if (transfer.pos_x == transfer.width) {
-        transfer.pos_x = 0;
-        transfer.pos_y++;
+    uint remaining = hblank_timings() + 1 - std::min<uint>(gpu_clock, hblank_timings());
+    return (remaining * 7 + 10) / 11;
+}
 
-        if (transfer.pos_y == transfer.height) {
-            transfer.pos_y = 0;
-            transfer.active = false;
+uint GPU::vram_transfer(ushort* data, uint count)
+{
+    auto& transfer = gpu_to_cpu;
+    uint moved = 0;
+
+    while (transfer.active && moved < count) {
+        uint x = (transfer.start_x + transfer.pos_x) % VRAM_WIDTH;
+        uint y = (transfer.start_y + transfer.pos_y) % VRAM_HEIGHT;
+
+        /* Copy up to the end of the row or the edge of VRAM. */
+        uint length = std::min({ count - moved, transfer.width - transfer.pos_x, VRAM_WIDTH - x });
+        vram.read_row(x, y, data + moved, length);
+        moved += length;
+
+        transfer.pos_x += length;
+        if (transfer.pos_x == transfer.width) {
+            transfer.pos_x = 0;
+            transfer.pos_y++;
+
+            if (transfer.pos_y == transfer.height) {
+                transfer.pos_y = 0;
+                transfer.active = false;
+            }
         }
     }
 
-    return data;
+    return moved;
 }
 
-void GPU::vram_transfer(ushort data) 
+uint GPU::vram_transfer(const ushort* data, uint count)
 {
     auto& transfer = cpu_to_gpu;
-    if (!transfer.active)
-        return;
+    uint moved = 0;
+
+    while (transfer.active && moved < count) {
+        uint x = (transfer.start_x + transfer.pos_x) % VRAM_WIDTH;
+        uint y = (transfer.start_y + transfer.pos_y) % VRAM_HEIGHT;
 
-    vram.write(transfer.start_x + transfer.pos_x,
-        transfer.start_y + transfer.pos_y, data);
+        /* Copy up to the end of the row or the edge of VRAM. */
+        uint length = std::min({ count - moved, transfer.width - transfer.pos_x, VRAM_WIDTH - x });
+        vram.write_row(x, y, data + moved, length, status.force_set_mask_bit, status.preserve_masked_pixels);
+        moved += length;
 
-    transfer.pos_x++;
-    if (transfer.pos_x == transfer.width) {
-        transfer.pos_x = 0;
-        transfer.pos_y++;
+        transfer.pos_x += length;
+        if (transfer.pos_x == transfer.width) {
+            transfer.pos_x = 0;
+            transfer.pos_y++;
 
-        if (transfer.pos_y == transfer.height) {
-            transfer.pos_y = 0;
-            transfer.active = false;
+            if (transfer.pos_y == transfer.height) {
+                transfer.pos_y = 0;
+                transfer.active = false;
 
-            vram.upload_to_gpu();
+                renderer->upload_vram();
+            }
         }
     }
+
+    return moved;
 }
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <memory/range.h>
 #include <devices/timer.h>
 
+/* Length of the horizontal blank in CPU cycles, about */
+/* 850 of the 3412 GPU clocks of an NTSC scanline. */
+constexpr uint HBLANK_CYCLES = 542;
+
 enum TexColors : uint {
     D4bit = 0,
     D8bit = 1,
@@ -115,6 +119,7 @@ public:
     GPUSync get_blanks_and_dot();
 
     bool tick(uint cycles);
+    uint cycles_until_scanline();
     ushort hblank_timings();
     ushort lines_per_frame();
 
@@ -124,9 +129,14 @@ public:
     uint get_gpuread();
     uint get_gpustat();
 
-    /* VRAM transfer commands. */
-    void vram_transfer(ushort data);
-    ushort vram_transfer();
+    /* Word blocks from DMA, same as one port access per word. */
+    void write_gp0(const uint* data, uint count);
+    void get_gpuread(uint* data, uint count);
+
+    /* VRAM transfer commands. These move halfwords until the */
+    /* active transfer is done and return how many they moved. */
+    uint vram_transfer(const ushort* data, uint count);
+    uint vram_transfer(ushort* data, uint count);
 
     /* Drawing commands. */
     void gp0_render_polygon();
@@ -148,7 +158,7 @@ public:
     void gp0_image_transfer();
 
 public:
-    Renderer* gl_renderer;
+    Renderer* renderer;
     GPUSTAT status;
 
     /* GP0 registers. */
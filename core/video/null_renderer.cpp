@@ -0,0 +1,8 @@
+#include <stdafx.hpp>
+#include "null_renderer.h"
+#include <video/vram.h>
+
+NullRenderer::NullRenderer()
+{
+	vram.init_headless();
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <video/renderer.h>
+
+/* Renderer for runs that only need the CPU. There is no window */
+/* or GL context, VRAM lives in host memory and draws are dropped. */
+class NullRenderer : public Renderer {
+public:
+	NullRenderer();
+	~NullRenderer() override = default;
+
+	void draw_call(std::vector<Vertex>&, Primitive, uint) override {}
+	void draw(std::vector<Vertex>&) override {}
+	void upload_vram() override {}
+	void sync() override {}
+
+	void update() override {}
+	void swap() override {}
+	bool is_open() override { return true; }
+};
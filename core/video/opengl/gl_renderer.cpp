@@ -1,10 +1,10 @@
 ﻿#include <stdafx.hpp>
 #include <glad/glad.h>
-#include "renderer.h"
+#include "gl_renderer.h"
 #include <memory/bus.h>
 #include <video/vram.h>
 
-Renderer::Renderer(int width, int height, const std::string& title, Bus* _bus) :
+GLRenderer::GLRenderer(int width, int height, const std::string& title, Bus* _bus) :
     bus(_bus)
 {
     window_width = width;
@@ -90,7 +90,7 @@ Renderer::Renderer(int width, int height, const std::string& title, Bus* _bus) :
     vram.init();
 }
 
-Renderer::~Renderer()
+GLRenderer::~GLRenderer()
 {
     glDeleteFramebuffers(1, &framebuffer);
     glDeleteTextures(1, &framebuffer_texture);
@@ -101,12 +101,16 @@ Renderer::~Renderer()
     glfwTerminate();
 }
 
-void Renderer::draw_call(std::vector<Vertex>& data, Primitive p)
+void GLRenderer::draw_call(std::vector<Vertex>& data, Primitive p, uint command)
 {
+    /* Lines are only drawn by the software renderer. */
+    if (p == Primitive::Line)
+        return;
+
     draw_data.insert(draw_data.end(), data.begin(), data.end());
 }
 
-void Renderer::draw(std::vector<Vertex>& data)
+void GLRenderer::draw(std::vector<Vertex>& data)
 {
     /* Get current display resolution. */
     int width = bus->gpu->width[bus->gpu->status.hres];
@@ -128,6 +132,9 @@ void Renderer::draw(std::vector<Vertex>& data)
     glBindBuffer(GL_ARRAY_BUFFER, draw_vbo);
     glBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(Vertex), data.data());
 
+    /* Bring the texture up to date with transfers since the last draw. */
+    vram.upload_to_gpu();
+
     shader->bind();
     vram.bind_vram_texture();
     int count = (int)data.size();
@@ -135,7 +142,7 @@ void Renderer::draw(std::vector<Vertex>& data)
     glDrawArrays(GL_TRIANGLES, 0, count);
 }
 
-void Renderer::update()
+void GLRenderer::update()
 {
     glfwPollEvents();
 
@@ -157,6 +164,8 @@ void Renderer::update()
     glBindBuffer(GL_ARRAY_BUFFER, draw_vbo);
     glBufferSubData(GL_ARRAY_BUFFER, 0, draw_data.size() * sizeof(Vertex), draw_data.data());
 
+    vram.upload_to_gpu();
+
     shader->bind();
     vram.bind_vram_texture();
     int count = (int)draw_data.size();
@@ -177,7 +186,7 @@ void Renderer::update()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void Renderer::swap()
+void GLRenderer::swap()
 {
     glfwSwapBuffers(window);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -186,7 +195,7 @@ void Renderer::swap()
     primitive_count = 0;
 }
 
-bool Renderer::is_open()
+bool GLRenderer::is_open()
 {
     return !glfwWindowShouldClose(window);
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <video/renderer.h>
+#include "shader.h"
+#include <GLFW/glfw3.h>
+
+constexpr int MAX_VERTICES = 1024 * 512;
+
+class GPU;
+class Bus;
+class GLRenderer : public Renderer {
+public:
+	GLRenderer(int width, int height, const std::string& title, Bus* _bus);
+	~GLRenderer() override;
+
+	void draw_call(std::vector<Vertex>& data, Primitive primitive, uint command) override;
+	void draw(std::vector<Vertex>& data) override;
+	/* VRAM tracks what changed, it is uploaded before drawing. */
+	void upload_vram() override {}
+	void sync() override {}
+
+	void update() override;
+	void swap() override;
+	bool is_open() override;
+
+public:
+	int32_t window_width, window_height;
+	uint framebuffer;
+	uint framebuffer_texture;
+	uint framebuffer_rbo;
+
+	uint draw_vbo, draw_vao;
+	uint primitive_count = 0;
+	std::vector<Vertex> draw_data;
+
+	std::unique_ptr<Shader> shader;
+	GLFWwindow* window;
+	Bus* bus;
+};
@@ -1,9 +1,11 @@
 #pragma once
-#include "opengl/shader.h"
 #include <video/gpu_core.h>
-#include <GLFW/glfw3.h>
 
-constexpr int MAX_VERTICES = 1024 * 512;
+enum class RendererType {
+	OpenGL,
+	Software,
+	Null
+};
 
 enum class Primitive {
 	Polygon = 0,
@@ -11,33 +13,24 @@ enum class Primitive {
 	Line = 2
 };
 
-class GPU;
-class Bus;
+/* Interface of the GPU drawing backends. The GL renderer draws */
+/* into a window, the software renderer draws into VRAM on the */
+/* CPU and the null renderer drops draws altogether. */
 class Renderer {
 public:
-	Renderer(int width, int height, const std::string& title, Bus* _bus);
-	~Renderer();
+	virtual ~Renderer() = default;
 
-	/* Batch vertex data. */
-	void draw_call(std::vector<Vertex>& data, Primitive primitive);
+	/* Batch vertex data, command is the first GP0 word. */
+	virtual void draw_call(std::vector<Vertex>& data, Primitive primitive, uint command) = 0;
 	/* Force draw vertex data. */
-	void draw(std::vector<Vertex>& data);
-
-	void update();
-	void swap();
-	bool is_open();
-
-public:
-	int32_t window_width, window_height;
-	uint framebuffer;
-	uint framebuffer_texture;
-	uint framebuffer_rbo;
-
-	uint draw_vbo, draw_vao;
-	uint primitive_count = 0;
-	std::vector<Vertex> draw_data;
-
-	std::unique_ptr<Shader> shader;
-	GLFWwindow* window;
-	Bus* bus;
-};                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                             
\ No newline at end of file
+	virtual void draw(std::vector<Vertex>& data) = 0;
+	/* VRAM was written by a transfer or a copy. */
+	virtual void upload_vram() = 0;
+	/* Finish queued draws before VRAM is accessed directly. */
+	virtual void sync() = 0;
+
+	/* Present the frame at vblank. */
+	virtual void update() = 0;
+	virtual void swap() = 0;
+	virtual bool is_open() = 0;
+};
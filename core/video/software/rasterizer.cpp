@@ -0,0 +1,203 @@
+#include <stdafx.hpp>
+#include "rasterizer.h"
+#include <video/software/span.h>
+
+RasterRect RasterRect::intersect(const RasterRect& other) const
+{
+	return RasterRect{ std::max(left, other.left), std::max(top, other.top),
+		std::min(right, other.right), std::min(bottom, other.bottom) };
+}
+
+static inline int64_t floor_div(int64_t n, int64_t d)
+{
+	return (n >= 0 ? n : n - d + 1) / d;
+}
+
+/* Edge function A*x + B*y + C of a triangle in clockwise */
+/* screen order, positive inside. Pixels on the edge only */
+/* count for left and top edges. */
+struct Edge {
+	int64_t a, b, c;
+	int64_t threshold;
+
+	Edge(const RasterVertex& v0, const RasterVertex& v1)
+	{
+		a = v0.y - v1.y;
+		b = v1.x - v0.x;
+		c = -(a * v0.x + b * v0.y);
+		threshold = (a > 0 || (a == 0 && b > 0)) ? 0 : 1;
+	}
+};
+
+/* Attribute plane in 16.16 fixed point. */
+struct Gradient {
+	int64_t dx = 0, dy = 0;
+
+	Gradient() = default;
+	Gradient(const RasterVertex* v, int RasterVertex::* attr, int64_t area)
+	{
+		int64_t d1 = v[1].*attr - v[0].*attr;
+		int64_t d2 = v[2].*attr - v[0].*attr;
+
+		dx = ((d1 * (v[2].y - v[0].y) - d2 * (v[1].y - v[0].y)) << 16) / area;
+		dy = ((d2 * (v[1].x - v[0].x) - d1 * (v[2].x - v[0].x)) << 16) / area;
+	}
+
+	int32_t at(const RasterVertex& origin, int value, int x, int y) const
+	{
+		return clamp32(((int64_t)value << 16) + dx * (x - origin.x) + dy * (y - origin.y) + 0x8000);
+	}
+
+	/* Steps only get this large on spans of a single pixel. */
+	int32_t step(int count) const
+	{
+		return count > 1 ? clamp32(dx) : 0;
+	}
+
+	static int32_t clamp32(int64_t value)
+	{
+		return (int32_t)std::clamp<int64_t>(value, INT32_MIN, INT32_MAX);
+	}
+};
+
+static void draw_triangle(const RasterPrimitive& p, const RasterRect& area, SpanKernel kernel)
+{
+	RasterVertex v[3] = { p.v[0], p.v[1], p.v[2] };
+
+	int64_t size = (int64_t)(v[1].x - v[0].x) * (v[2].y - v[0].y) -
+		(int64_t)(v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (size == 0)
+		return;
+
+	if (size < 0) {
+		std::swap(v[1], v[2]);
+		size = -size;
+	}
+
+	Edge edges[3] = { Edge(v[0], v[1]), Edge(v[1], v[2]), Edge(v[2], v[0]) };
+
+	Gradient gr, gg, gb, gu, gv;
+	if (p.shaded) {
+		gr = Gradient(v, &RasterVertex::r, size);
+		gg = Gradient(v, &RasterVertex::g, size);
+		gb = Gradient(v, &RasterVertex::b, size);
+	}
+	if (p.textured) {
+		gu = Gradient(v, &RasterVertex::u, size);
+		gv = Gradient(v, &RasterVertex::v, size);
+	}
+
+	for (int y = area.top; y <= area.bottom; y++) {
+		/* Solve the edge functions for the covered span. */
+		int64_t left = area.left, right = area.right;
+		for (auto& e : edges) {
+			int64_t k = e.b * y + e.c;
+			if (e.a > 0)
+				left = std::max(left, -floor_div(k - e.threshold, e.a));
+			else if (e.a < 0)
+				right = std::min(right, floor_div(k - e.threshold, -e.a));
+			else if (k < e.threshold)
+				right = left - 1;
+		}
+
+		if (left > right)
+			continue;
+
+		Span span = {};
+		span.x = (int)left;
+		span.y = y;
+		span.count = (int)(right - left + 1);
+
+		span.r = gr.at(v[0], v[0].r, span.x, y); span.dr = gr.step(span.count);
+		span.g = gg.at(v[0], v[0].g, span.x, y); span.dg = gg.step(span.count);
+		span.b = gb.at(v[0], v[0].b, span.x, y); span.db = gb.step(span.count);
+		span.u = gu.at(v[0], v[0].u, span.x, y); span.du = gu.step(span.count);
+		span.v = gv.at(v[0], v[0].v, span.x, y); span.dv = gv.step(span.count);
+
+		kernel(p, span);
+	}
+}
+
+/* Rectangles step the texture one texel per pixel and */
+/* are never shaded or dithered. */
+static void draw_rectangle(const RasterPrimitive& p, const RasterRect& area, SpanKernel kernel)
+{
+	auto& origin = p.v[0];
+
+	for (int y = area.top; y <= area.bottom; y++) {
+		Span span = {};
+		span.x = area.left;
+		span.y = y;
+		span.count = area.right - area.left + 1;
+
+		span.r = origin.r << 16;
+		span.g = origin.g << 16;
+		span.b = origin.b << 16;
+		span.u = (origin.u + area.left - origin.x) << 16;
+		span.v = (origin.v + y - origin.y) << 16;
+		span.du = 1 << 16;
+
+		kernel(p, span);
+	}
+}
+
+/* Lines step along the major axis and include both ends. */
+static void draw_line(const RasterPrimitive& p, const RasterRect& area)
+{
+	auto& a = p.v[0];
+	auto& b = p.v[1];
+
+	int steps = std::max(std::abs(b.x - a.x), std::abs(b.y - a.y));
+	int64_t div = std::max(steps, 1);
+
+	int64_t x = ((int64_t)a.x << 16) + 0x8000, y = ((int64_t)a.y << 16) + 0x8000;
+	int64_t r = ((int64_t)a.r << 16) + 0x8000, g = ((int64_t)a.g << 16) + 0x8000;
+	int64_t c = ((int64_t)a.b << 16) + 0x8000;
+
+	int64_t dx = ((int64_t)(b.x - a.x) << 16) / div, dy = ((int64_t)(b.y - a.y) << 16) / div;
+	int64_t dr = ((int64_t)(b.r - a.r) << 16) / div, dg = ((int64_t)(b.g - a.g) << 16) / div;
+	int64_t dc = ((int64_t)(b.b - a.b) << 16) / div;
+
+	for (int i = 0; i <= steps; i++) {
+		int px = (int)(x >> 16), py = (int)(y >> 16);
+
+		if (px >= area.left && px <= area.right && py >= area.top && py <= area.bottom) {
+			Span span = {};
+			span.x = px;
+			span.y = py;
+			span.count = 1;
+
+			span.r = (int32_t)r;
+			span.g = (int32_t)g;
+			span.b = (int32_t)c;
+
+			span_scalar(p, span);
+		}
+
+		x += dx; y += dy;
+		r += dr; g += dg; c += dc;
+	}
+}
+
+/* Fills ignore the mask settings and every other state. */
+static void draw_fill(const RasterPrimitive& p, const RasterRect& area)
+{
+	for (int y = area.top; y <= area.bottom; y++) {
+		ushort* row = vram.ptr + y * VRAM_WIDTH;
+		std::fill(row + area.left, row + area.right + 1, p.fill);
+	}
+}
+
+void rasterize(const RasterPrimitive& p, const RasterRect& tile, SpanKernel kernel)
+{
+	RasterRect area = p.bounds.intersect(tile);
+	if (area.empty())
+		return;
+
+	switch (p.type) {
+	case RasterType::Triangle: draw_triangle(p, area, kernel); break;
+	case RasterType::Rectangle: draw_rectangle(p, area, kernel); break;
+	case RasterType::Line: draw_line(p, area); break;
+	case RasterType::Fill: draw_fill(p, area); break;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <video/vram.h>
+
+/* The software renderer splits VRAM into square tiles and */
+/* rasterizes each tile on its own thread. */
+constexpr int TILE_SIZE = 64;
+constexpr int TILES_X = VRAM_WIDTH / TILE_SIZE;
+constexpr int TILES_Y = VRAM_HEIGHT / TILE_SIZE;
+constexpr int TILE_COUNT = TILES_X * TILES_Y;
+
+enum class RasterType : ubyte {
+	Triangle,
+	Rectangle,
+	Line,
+	Fill
+};
+
+/* Inclusive rectangle of VRAM pixels. */
+struct RasterRect {
+	int left, top, right, bottom;
+
+	bool empty() const { return left > right || top > bottom; }
+	RasterRect intersect(const RasterRect& other) const;
+};
+
+struct RasterVertex {
+	int x, y;
+	int r, g, b;
+	int u, v;
+};
+
+/* A primitive along with the draw state it was submitted */
+/* with, so it can be rasterized long after GP0 moved on. */
+struct RasterPrimitive {
+	RasterType type;
+	bool shaded, textured, raw_texture;
+	bool semi_transparent, dither;
+	bool set_mask, check_mask;
+	ubyte semi_mode, depth;
+
+	/* Texture page and CLUT in VRAM pixels. */
+	ushort tx, ty, cx, cy;
+	/* Texture window, as masks applied to u and v. */
+	ubyte window_and_u, window_or_u;
+	ubyte window_and_v, window_or_v;
+
+	/* Fill color in VRAM format. */
+	ushort fill;
+
+	/* Pixels the primitive may touch, already */
+	/* clipped to the drawing area. */
+	RasterRect bounds;
+	RasterVertex v[3];
+};
+
+struct Span;
+using SpanKernel = void (*)(const RasterPrimitive& p, const Span& span);
+
+/* Kernel spans are shaded with, the widest one the host */
+/* supports unless changed. */
+extern SpanKernel span_kernel;
+
+/* Draws the part of the primitive inside the tile. */
+void rasterize(const RasterPrimitive& p, const RasterRect& tile, SpanKernel kernel = span_kernel);
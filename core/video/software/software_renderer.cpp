@@ -0,0 +1,322 @@
+#include <stdafx.hpp>
+#include "software_renderer.h"
+#include <video/software/span.h>
+#include <memory/bus.h>
+#include <utility/utility.hpp>
+
+SoftwareRenderer::SoftwareRenderer(Bus* _bus, uint threads) :
+	bus(_bus)
+{
+	vram.init_headless();
+	primitives.reserve(MAX_RASTER_BATCH);
+
+	/* The thread that submits the batch draws tiles too. */
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (uint i = 1; i < threads; i++)
+		workers.emplace_back(&SoftwareRenderer::worker_loop, this);
+
+	printf("[GPU] Software renderer: %u threads, %s spans.\n", threads, span_kernel_name(span_kernel));
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	sync();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+
+	start.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+/* Captures the GPU state a primitive is drawn with. */
+RasterPrimitive SoftwareRenderer::setup(const Vertex& vertex, Primitive primitive, uint command)
+{
+	auto& gpu = bus->gpu;
+	auto& status = gpu->status;
+
+	RasterPrimitive p = {};
+	p.shaded = primitive != Primitive::Rectangle && util::get_bit(command, 28);
+	p.textured = primitive != Primitive::Line && util::get_bit(command, 26);
+	p.raw_texture = p.textured && util::get_bit(command, 24);
+	p.semi_transparent = util::get_bit(command, 25);
+	p.semi_mode = status.semi_transprency;
+	p.set_mask = status.force_set_mask_bit;
+	p.check_mask = status.preserve_masked_pixels;
+
+	/* Only shaded and texture blended primitives are */
+	/* dithered, rectangles never are. */
+	p.dither = status.dithering && primitive != Primitive::Rectangle &&
+		(p.shaded || (p.textured && !p.raw_texture));
+
+	if (p.textured) {
+		p.tx = (ushort)vertex.texpage.x;
+		p.ty = (ushort)vertex.texpage.y;
+		p.cx = (ushort)vertex.clut_coord.x;
+		p.cy = (ushort)vertex.clut_coord.y;
+
+		int color_depth = (int)vertex.color_depth;
+		p.depth = (color_depth == 4 ? D4bit : color_depth == 8 ? D8bit : D15bit);
+
+		p.window_and_u = (ubyte)~(gpu->texture_window_mask.x * 8);
+		p.window_or_u = (ubyte)((gpu->texture_window_offset.x & gpu->texture_window_mask.x) * 8);
+		p.window_and_v = (ubyte)~(gpu->texture_window_mask.y * 8);
+		p.window_or_v = (ubyte)((gpu->texture_window_offset.y & gpu->texture_window_mask.y) * 8);
+	}
+
+	auto& top_left = gpu->drawing_area_top_left;
+	auto& bottom_right = gpu->drawing_area_bottom_right;
+	p.bounds = RasterRect{ top_left.x, top_left.y,
+		std::min<int>(bottom_right.x, VRAM_WIDTH - 1),
+		std::min<int>(bottom_right.y, VRAM_HEIGHT - 1) };
+
+	return p;
+}
+
+void SoftwareRenderer::draw_call(std::vector<Vertex>& data, Primitive primitive, uint command)
+{
+	if (data.empty())
+		return;
+
+	RasterPrimitive p = setup(data[0], primitive, command);
+	auto base = bus->gpu->unpack_color(command);
+
+	auto convert = [&](const Vertex& vertex) {
+		auto color = p.shaded ? glm::ivec3(vertex.color) : base;
+		return RasterVertex{ (int)vertex.pos.x, (int)vertex.pos.y,
+			color.r, color.g, color.b, (int)vertex.coord.x, (int)vertex.coord.y };
+	};
+
+	RasterRect clip = p.bounds;
+	switch (primitive) {
+	case Primitive::Polygon:
+		/* Quads come in as two triangles. */
+		for (size_t i = 0; i + 2 < data.size(); i += 3) {
+			p.type = RasterType::Triangle;
+			for (int j = 0; j < 3; j++)
+				p.v[j] = convert(data[i + j]);
+
+			auto& v = p.v;
+			int left = std::min({ v[0].x, v[1].x, v[2].x }), right = std::max({ v[0].x, v[1].x, v[2].x });
+			int top = std::min({ v[0].y, v[1].y, v[2].y }), bottom = std::max({ v[0].y, v[1].y, v[2].y });
+
+			/* The GPU skips polygons larger than 1023x511. */
+			if (right - left >= VRAM_WIDTH || bottom - top >= VRAM_HEIGHT)
+				continue;
+
+			p.bounds = clip.intersect(RasterRect{ left, top, right, bottom });
+			submit(p);
+		}
+		break;
+	case Primitive::Rectangle: {
+		p.type = RasterType::Rectangle;
+		p.v[0] = convert(data[0]);
+
+		int width = (int)(data[3].pos.x - data[0].pos.x);
+		int height = (int)(data[3].pos.y - data[0].pos.y);
+		p.bounds = clip.intersect(RasterRect{ p.v[0].x, p.v[0].y,
+			p.v[0].x + width - 1, p.v[0].y + height - 1 });
+		submit(p);
+		break;
+	}
+	case Primitive::Line:
+		for (size_t i = 0; i + 1 < data.size(); i += 2) {
+			p.type = RasterType::Line;
+			p.v[0] = convert(data[i]);
+			p.v[1] = convert(data[i + 1]);
+
+			auto& a = p.v[0];
+			auto& b = p.v[1];
+			if (std::abs(b.x - a.x) >= VRAM_WIDTH || std::abs(b.y - a.y) >= VRAM_HEIGHT)
+				continue;
+
+			p.bounds = clip.intersect(RasterRect{ std::min(a.x, b.x), std::min(a.y, b.y),
+				std::max(a.x, b.x), std::max(a.y, b.y) });
+			submit(p);
+		}
+		break;
+	}
+}
+
+/* Only fills are force drawn. They ignore the drawing */
+/* area and wrap around the edges of VRAM. */
+void SoftwareRenderer::draw(std::vector<Vertex>& data)
+{
+	RasterPrimitive p = {};
+	p.type = RasterType::Fill;
+
+	auto color = glm::ivec3(data[0].color);
+	p.fill = (ushort)((color.r >> 3) | ((color.g >> 3) << 5) | ((color.b >> 3) << 10));
+
+	int x = (int)data[0].pos.x, y = (int)data[0].pos.y;
+	int width = (int)data[3].pos.x - x, height = (int)data[3].pos.y - y;
+
+	for (int top = y; top < y + height; top += VRAM_HEIGHT - (top % VRAM_HEIGHT)) {
+		int bottom = std::min(y + height, top - (top % VRAM_HEIGHT) + VRAM_HEIGHT);
+
+		for (int left = x; left < x + width; left += VRAM_WIDTH - (left % VRAM_WIDTH)) {
+			int right = std::min(x + width, left - (left % VRAM_WIDTH) + VRAM_WIDTH);
+
+			int wrapped_left = left % VRAM_WIDTH, wrapped_top = top % VRAM_HEIGHT;
+			p.bounds = RasterRect{ wrapped_left, wrapped_top,
+				wrapped_left + (right - left) - 1, wrapped_top + (bottom - top) - 1 };
+			submit(p);
+		}
+	}
+}
+
+/* Visits the tiles of the texture page and CLUT. */
+template <typename Func>
+void SoftwareRenderer::for_each_texture_tile(const RasterPrimitive& p, Func func)
+{
+	auto visit = [&](int x, int y, int width, int height) {
+		int bottom = std::min(y + height - 1, VRAM_HEIGHT - 1) / TILE_SIZE;
+		int right = (x + width - 1) / TILE_SIZE;
+
+		/* Pages wrap around the right edge of VRAM. */
+		for (int ty = y / TILE_SIZE; ty <= bottom; ty++) {
+			for (int tx = x / TILE_SIZE; tx <= right; tx++)
+				func(ty * TILES_X + (tx % TILES_X));
+		}
+	};
+
+	int widths[3] = { 64, 128, 256 };
+	visit(p.tx, p.ty, widths[p.depth], 256);
+
+	if (p.depth != D15bit)
+		visit(p.cx, p.cy, p.depth == D4bit ? 16 : 256, 1);
+}
+
+void SoftwareRenderer::submit(const RasterPrimitive& p)
+{
+	if (p.bounds.empty())
+		return;
+
+	int left = p.bounds.left / TILE_SIZE, right = p.bounds.right / TILE_SIZE;
+	int top = p.bounds.top / TILE_SIZE, bottom = p.bounds.bottom / TILE_SIZE;
+
+	/* Textures have to see everything drawn before them */
+	/* and nothing drawn after them. */
+	bool hazard = primitives.size() == MAX_RASTER_BATCH;
+	for (int ty = top; ty <= bottom; ty++) {
+		for (int tx = left; tx <= right; tx++)
+			hazard = hazard || sampled[ty * TILES_X + tx];
+	}
+
+	bool feedback = false;
+	if (p.textured) {
+		for_each_texture_tile(p, [&](uint tile) {
+			int tx = tile % TILES_X, ty = tile / TILES_X;
+			hazard = hazard || !bins[tile].empty();
+			feedback = feedback || (tx >= left && tx <= right && ty >= top && ty <= bottom);
+		});
+	}
+
+	if (hazard || feedback)
+		sync();
+
+	/* A texture that reads what the primitive itself draws */
+	/* depends on pixel order, draw it right away one pixel */
+	/* at a time like the GPU does. */
+	if (feedback) {
+		rasterize(p, RasterRect{ 0, 0, VRAM_WIDTH - 1, VRAM_HEIGHT - 1 }, span_scalar);
+		return;
+	}
+
+	uint index = (uint)primitives.size();
+	primitives.push_back(p);
+
+	for (int ty = top; ty <= bottom; ty++) {
+		for (int tx = left; tx <= right; tx++) {
+			uint tile = ty * TILES_X + tx;
+			if (bins[tile].empty())
+				tiles[tile_count++] = tile;
+
+			bins[tile].push_back(index);
+		}
+	}
+
+	if (p.textured)
+		for_each_texture_tile(p, [&](uint tile) { sampled[tile] = true; });
+}
+
+/* Draws every queued primitive and waits for the workers. */
+void SoftwareRenderer::sync()
+{
+	if (primitives.empty())
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busy == 0; });
+
+		dispatched = tile_count;
+		finished_tiles = 0;
+		next_tile = 0;
+		generation++;
+	}
+
+	start.notify_all();
+	run_tiles();
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busy == 0 && finished_tiles == dispatched; });
+	}
+
+	for (uint i = 0; i < tile_count; i++)
+		bins[tiles[i]].clear();
+
+	tile_count = 0;
+	std::fill(std::begin(sampled), std::end(sampled), false);
+	primitives.clear();
+	batches++;
+}
+
+void SoftwareRenderer::run_tiles()
+{
+	uint index;
+	while ((index = next_tile++) < dispatched) {
+		uint tile = tiles[index];
+		int x = (tile % TILES_X) * TILE_SIZE, y = (tile / TILES_X) * TILE_SIZE;
+		RasterRect area = { x, y, x + TILE_SIZE - 1, y + TILE_SIZE - 1 };
+
+		for (uint primitive : bins[tile])
+			rasterize(primitives[primitive], area);
+
+		finished_tiles++;
+	}
+}
+
+void SoftwareRenderer::worker_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	uint seen = generation;
+
+	while (true) {
+		start.wait(lock, [&] { return quit || generation != seen; });
+		if (quit)
+			return;
+
+		seen = generation;
+		busy++;
+
+		lock.unlock();
+		run_tiles();
+		lock.lock();
+
+		if (--busy == 0)
+			done.notify_all();
+	}
+}
+
+/* The frame is complete at vblank. */
+void SoftwareRenderer::update()
+{
+	sync();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <video/renderer.h>
+#include <video/software/rasterizer.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* Primitives queued before the tiles are rasterized anyway. */
+constexpr uint MAX_RASTER_BATCH = 4096;
+
+class Bus;
+
+/* Draws into VRAM on the CPU, for headless runs. Primitives */
+/* are binned into the tiles they touch and every tile is */
+/* drawn in submission order by a pool of workers. The batch */
+/* is finished before a texture reads a tile it draws to, */
+/* before it draws to a tile a texture reads and before VRAM */
+/* is accessed directly. */
+class SoftwareRenderer : public Renderer {
+public:
+	/* Zero threads uses one per host core. */
+	SoftwareRenderer(Bus* _bus, uint threads = 0);
+	~SoftwareRenderer() override;
+
+	void draw_call(std::vector<Vertex>& data, Primitive primitive, uint command) override;
+	void draw(std::vector<Vertex>& data) override;
+	void upload_vram() override {}
+	void sync() override;
+
+	void update() override;
+	void swap() override {}
+	bool is_open() override { return true; }
+
+private:
+	RasterPrimitive setup(const Vertex& vertex, Primitive primitive, uint command);
+	void submit(const RasterPrimitive& p);
+	template <typename Func>
+	void for_each_texture_tile(const RasterPrimitive& p, Func func);
+
+	void worker_loop();
+	void run_tiles();
+
+public:
+	ulong batches = 0;
+
+private:
+	Bus* bus;
+	std::vector<RasterPrimitive> primitives;
+	std::vector<uint> bins[TILE_COUNT];
+
+	/* Tiles of the current batch that have primitives. */
+	uint tiles[TILE_COUNT] = {};
+	uint tile_count = 0;
+
+	/* Tiles textures of the current batch read from. */
+	bool sampled[TILE_COUNT] = {};
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start, done;
+	uint generation = 0, busy = 0;
+	bool quit = false;
+	std::atomic<uint> next_tile{ 0 }, finished_tiles{ 0 };
+	uint dispatched = 0;
+};
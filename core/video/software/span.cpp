@@ -0,0 +1,179 @@
+#include <stdafx.hpp>
+#include "span.h"
+#include <video/gpu_core.h>
+
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+const int DITHER[4][12] =
+{
+	{ -4,  0, -3,  1, -4,  0, -3,  1, -4,  0, -3,  1 },
+	{  2, -2,  3, -1,  2, -2,  3, -1,  2, -2,  3, -1 },
+	{ -3,  1, -4,  0, -3,  1, -4,  0, -3,  1, -4,  0 },
+	{  3, -1,  2, -2,  3, -1,  2, -2,  3, -1,  2, -2 }
+};
+
+static inline ushort fetch_texel(const RasterPrimitive& p, int u, int v)
+{
+	u = (u & p.window_and_u) | p.window_or_u;
+	v = (v & p.window_and_v) | p.window_or_v;
+
+	ushort* row = vram.ptr + ((p.ty + v) & (VRAM_HEIGHT - 1)) * VRAM_WIDTH;
+	ushort* clut = vram.ptr + p.cy * VRAM_WIDTH;
+
+	switch (p.depth) {
+	case D4bit: {
+		uint index = (row[(p.tx + u / 4) & (VRAM_WIDTH - 1)] >> ((u & 3) * 4)) & 0xf;
+		return clut[(p.cx + index) & (VRAM_WIDTH - 1)];
+	}
+	case D8bit: {
+		uint index = (row[(p.tx + u / 2) & (VRAM_WIDTH - 1)] >> ((u & 1) * 8)) & 0xff;
+		return clut[(p.cx + index) & (VRAM_WIDTH - 1)];
+	}
+	default:
+		return row[(p.tx + u) & (VRAM_WIDTH - 1)];
+	}
+}
+
+static inline ushort blend(ushort back, ushort front, uint mode)
+{
+	int result = 0;
+	for (int shift = 0; shift < 15; shift += 5) {
+		int b = (back >> shift) & 0x1f;
+		int f = (front >> shift) & 0x1f;
+
+		int c;
+		switch (mode) {
+		case 0: c = (b + f) >> 1; break;
+		case 1: c = std::min(b + f, 31); break;
+		case 2: c = std::max(b - f, 0); break;
+		default: c = std::min(b + (f >> 2), 31); break;
+		}
+
+		result |= c << shift;
+	}
+
+	return (ushort)result;
+}
+
+void span_scalar(const RasterPrimitive& p, const Span& span)
+{
+	ushort* dest = vram.ptr + span.y * VRAM_WIDTH + span.x;
+	const int* dither = DITHER[span.y & 3] + (span.x & 3);
+
+	int32_t ar = span.r, ag = span.g, ab = span.b, au = span.u, av = span.v;
+	for (int i = 0; i < span.count; i++, ar += span.dr, ag += span.dg, ab += span.db, au += span.du, av += span.dv) {
+		if (p.check_mask && (dest[i] & 0x8000))
+			continue;
+
+		int r = std::clamp(ar >> 16, 0, 255);
+		int g = std::clamp(ag >> 16, 0, 255);
+		int b = std::clamp(ab >> 16, 0, 255);
+
+		ushort texel = 0;
+		if (p.textured) {
+			texel = fetch_texel(p, (au >> 16) & 0xff, (av >> 16) & 0xff);
+
+			/* Texel 0000h is fully transparent. */
+			if (texel == 0)
+				continue;
+
+			int tr = texel & 0x1f, tg = (texel >> 5) & 0x1f, tb = (texel >> 10) & 0x1f;
+			if (p.raw_texture) {
+				r = tr << 3; g = tg << 3; b = tb << 3;
+			}
+			else {
+				/* A vertex color of 80h leaves the texel as is. */
+				r = std::min((tr * r) >> 4, 255);
+				g = std::min((tg * g) >> 4, 255);
+				b = std::min((tb * b) >> 4, 255);
+			}
+		}
+
+		if (p.dither) {
+			int offset = dither[i & 3];
+			r = std::clamp(r + offset, 0, 255);
+			g = std::clamp(g + offset, 0, 255);
+			b = std::clamp(b + offset, 0, 255);
+		}
+
+		ushort color = (ushort)((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10));
+
+		/* Textured primitives only blend texels with bit 15 set. */
+		if (p.semi_transparent && (!p.textured || (texel & 0x8000)))
+			color = blend(dest[i], color, p.semi_mode);
+
+		color |= (texel & 0x8000);
+		if (p.set_mask)
+			color |= 0x8000;
+
+		dest[i] = color;
+	}
+}
+
+static bool has_sse41 = false, has_avx2 = false;
+
+static void detect_features()
+{
+	int info[4] = {};
+	auto cpuid = [&](int leaf, int subleaf) {
+#ifdef _WIN32
+		__cpuidex(info, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+	};
+
+	cpuid(0, 0);
+	int max_leaf = info[0];
+
+	cpuid(1, 0);
+	has_sse41 = (info[2] >> 19) & 1;
+	bool osxsave = (info[2] >> 27) & 1;
+	bool avx = (info[2] >> 28) & 1;
+
+	/* AVX2 also needs the OS to save the YMM registers. */
+	bool ymm_saved = false;
+	if (osxsave && avx) {
+#ifdef _WIN32
+		ulong xcr0 = _xgetbv(0);
+#else
+		uint eax, edx;
+		__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		ulong xcr0 = ((ulong)edx << 32) | eax;
+#endif
+		ymm_saved = (xcr0 & 6) == 6;
+	}
+
+	if (max_leaf >= 7 && ymm_saved) {
+		cpuid(7, 0);
+		has_avx2 = (info[1] >> 5) & 1;
+	}
+}
+
+SpanKernel select_span_kernel()
+{
+	detect_features();
+
+	if (has_avx2)
+		return span_avx2;
+	else if (has_sse41)
+		return span_sse41;
+	else
+		return span_scalar;
+}
+
+SpanKernel span_kernel = select_span_kernel();
+
+const char* span_kernel_name(SpanKernel kernel)
+{
+	if (kernel == span_avx2)
+		return "AVX2";
+	else if (kernel == span_sse41)
+		return "SSE4.1";
+	else
+		return "scalar";
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <video/software/rasterizer.h>
+
+/* A horizontal run of pixels of one primitive. Attributes */
+/* are 16.16 fixed point at the first pixel and step once */
+/* per pixel. */
+struct Span {
+	int x, y, count;
+	int32_t r, g, b, u, v;
+	int32_t dr, dg, db, du, dv;
+};
+
+/* Kernels shade a span and write it to VRAM: texel fetch, */
+/* CLUT lookup, modulation, dithering, blending and mask test. */
+
+/* The 4x4 ordered dither, each row repeated so eight */
+/* offsets can be read from any starting column. */
+extern const int DITHER[4][12];
+
+void span_scalar(const RasterPrimitive& p, const Span& span);
+void span_sse41(const RasterPrimitive& p, const Span& span);
+void span_avx2(const RasterPrimitive& p, const Span& span);
+
+/* Picks the widest kernel the host supports. */
+SpanKernel select_span_kernel();
+const char* span_kernel_name(SpanKernel kernel);
+
@@ -0,0 +1,73 @@
+#include <stdafx.hpp>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define SIMD_TARGET
+#else
+#define SIMD_TARGET __attribute__((target("avx2")))
+#endif
+
+#include "span_simd.h"
+
+/* Eight lanes in one YMM register, texels are gathered. */
+struct AVX2Vector {
+	__m256i m;
+
+	SIMD_TARGET static AVX2Vector make(__m256i m) { return AVX2Vector{ m }; }
+	SIMD_TARGET static AVX2Vector zero() { return make(_mm256_setzero_si256()); }
+	SIMD_TARGET static AVX2Vector ones() { return make(_mm256_set1_epi32(-1)); }
+	SIMD_TARGET static AVX2Vector set1(int value) { return make(_mm256_set1_epi32(value)); }
+	SIMD_TARGET static AVX2Vector iota() { return make(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+	SIMD_TARGET static AVX2Vector load32(const int* data)
+	{
+		return make(_mm256_loadu_si256((const __m256i*)data));
+	}
+
+	SIMD_TARGET static AVX2Vector load16(const ushort* data)
+	{
+		return make(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)data)));
+	}
+
+	SIMD_TARGET static void store16(ushort* data, AVX2Vector value)
+	{
+		__m256i packed = _mm256_packus_epi32(value.m, value.m);
+		packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i*)data, _mm256_castsi256_si128(packed));
+	}
+
+	/* Gathers the aligned word holding each halfword, */
+	/* so nothing past the end of VRAM is read. */
+	SIMD_TARGET static AVX2Vector gather16(const ushort* base, AVX2Vector index)
+	{
+		__m256i words = _mm256_i32gather_epi32((const int*)base, _mm256_srli_epi32(index.m, 1), 4);
+		__m256i shift = _mm256_slli_epi32(_mm256_and_si256(index.m, _mm256_set1_epi32(1)), 4);
+		return make(_mm256_and_si256(_mm256_srlv_epi32(words, shift), _mm256_set1_epi32(0xffff)));
+	}
+
+	SIMD_TARGET static AVX2Vector srlv(AVX2Vector a, AVX2Vector count) { return make(_mm256_srlv_epi32(a.m, count.m)); }
+	SIMD_TARGET static AVX2Vector min(AVX2Vector a, AVX2Vector b) { return make(_mm256_min_epi32(a.m, b.m)); }
+	SIMD_TARGET static AVX2Vector max(AVX2Vector a, AVX2Vector b) { return make(_mm256_max_epi32(a.m, b.m)); }
+	SIMD_TARGET static AVX2Vector eq(AVX2Vector a, AVX2Vector b) { return make(_mm256_cmpeq_epi32(a.m, b.m)); }
+	SIMD_TARGET static AVX2Vector gt(AVX2Vector a, AVX2Vector b) { return make(_mm256_cmpgt_epi32(a.m, b.m)); }
+	SIMD_TARGET static AVX2Vector andnot(AVX2Vector a, AVX2Vector b) { return make(_mm256_andnot_si256(a.m, b.m)); }
+
+	SIMD_TARGET static AVX2Vector select(AVX2Vector mask, AVX2Vector a, AVX2Vector b)
+	{
+		return make(_mm256_blendv_epi8(b.m, a.m, mask.m));
+	}
+
+	SIMD_TARGET AVX2Vector sra(int shift) const { return make(_mm256_srai_epi32(m, shift)); }
+	SIMD_TARGET AVX2Vector operator>>(int shift) const { return make(_mm256_srli_epi32(m, shift)); }
+	SIMD_TARGET AVX2Vector operator<<(int shift) const { return make(_mm256_slli_epi32(m, shift)); }
+	SIMD_TARGET AVX2Vector operator+(AVX2Vector b) const { return make(_mm256_add_epi32(m, b.m)); }
+	SIMD_TARGET AVX2Vector operator-(AVX2Vector b) const { return make(_mm256_sub_epi32(m, b.m)); }
+	SIMD_TARGET AVX2Vector operator*(AVX2Vector b) const { return make(_mm256_mullo_epi32(m, b.m)); }
+	SIMD_TARGET AVX2Vector operator&(AVX2Vector b) const { return make(_mm256_and_si256(m, b.m)); }
+	SIMD_TARGET AVX2Vector operator|(AVX2Vector b) const { return make(_mm256_or_si256(m, b.m)); }
+};
+
+SIMD_TARGET void span_avx2(const RasterPrimitive& p, const Span& span)
+{
+	span_simd<AVX2Vector>(p, span);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <video/software/span.h>
+#include <video/gpu_core.h>
+
+/* Span kernel shared by the SIMD backends. V holds eight */
+/* 32 bit lanes, one per pixel. The including file defines */
+/* V and SIMD_TARGET for its instruction set. */
+
+template <typename V>
+SIMD_TARGET inline V clamp_color(V value)
+{
+	return V::min(V::max(value, V::zero()), V::set1(255));
+}
+
+template <typename V>
+SIMD_TARGET inline V blend_lanes(V back, V front, uint mode)
+{
+	V result = V::zero();
+	V channel = V::set1(0x1f);
+
+	for (int shift = 0; shift < 15; shift += 5) {
+		V b = (back >> shift) & channel;
+		V f = (front >> shift) & channel;
+
+		V c;
+		switch (mode) {
+		case 0: c = (b + f) >> 1; break;
+		case 1: c = V::min(b + f, channel); break;
+		case 2: c = V::max(b - f, V::zero()); break;
+		default: c = V::min(b + (f >> 2), channel); break;
+		}
+
+		result = result | (c << shift);
+	}
+
+	return result;
+}
+
+template <typename V>
+SIMD_TARGET inline V fetch_texels(const RasterPrimitive& p, V au, V av)
+{
+	V u = ((au >> 16) & V::set1(p.window_and_u)) | V::set1(p.window_or_u);
+	V v = ((av >> 16) & V::set1(p.window_and_v)) | V::set1(p.window_or_v);
+	V row = ((v + V::set1(p.ty)) & V::set1(VRAM_HEIGHT - 1)) << 10;
+
+	V columns = V::set1(VRAM_WIDTH - 1);
+	V clut = V::set1(p.cy << 10);
+
+	switch (p.depth) {
+	case D4bit: {
+		V word = V::gather16(vram.ptr, row | (((u >> 2) + V::set1(p.tx)) & columns));
+		V index = V::srlv(word, (u & V::set1(3)) << 2) & V::set1(0xf);
+		return V::gather16(vram.ptr, clut | ((index + V::set1(p.cx)) & columns));
+	}
+	case D8bit: {
+		V word = V::gather16(vram.ptr, row | (((u >> 1) + V::set1(p.tx)) & columns));
+		V index = V::srlv(word, (u & V::set1(1)) << 3) & V::set1(0xff);
+		return V::gather16(vram.ptr, clut | ((index + V::set1(p.cx)) & columns));
+	}
+	default:
+		return V::gather16(vram.ptr, row | ((u + V::set1(p.tx)) & columns));
+	}
+}
+
+template <typename V>
+SIMD_TARGET void span_simd(const RasterPrimitive& p, const Span& span)
+{
+	ushort* dest = vram.ptr + span.y * VRAM_WIDTH + span.x;
+	const int* dither = DITHER[span.y & 3] + (span.x & 3);
+
+	V lane = V::iota();
+	V ar = V::set1(span.r) + lane * V::set1(span.dr);
+	V ag = V::set1(span.g) + lane * V::set1(span.dg);
+	V ab = V::set1(span.b) + lane * V::set1(span.db);
+	V au = V::set1(span.u) + lane * V::set1(span.du);
+	V av = V::set1(span.v) + lane * V::set1(span.dv);
+
+	V bit15 = V::set1(0x8000);
+	V set_mask = V::set1(p.set_mask ? 0x8000 : 0);
+
+	for (int i = 0; i < span.count; i += 8) {
+		/* The tail goes through a copy, so the lanes past */
+		/* the span never touch pixels of another tile. */
+		int count = std::min(8, span.count - i);
+		ushort tail[8] = {};
+		ushort* pixels = dest + i;
+		if (count < 8) {
+			std::memcpy(tail, pixels, count * sizeof(ushort));
+			pixels = tail;
+		}
+
+		V back = V::load16(pixels);
+		V write = V::gt(V::set1(count), lane);
+		if (p.check_mask)
+			write = write & V::eq(back & bit15, V::zero());
+
+		V r = clamp_color(ar.sra(16));
+		V g = clamp_color(ag.sra(16));
+		V b = clamp_color(ab.sra(16));
+
+		V texel = V::zero();
+		if (p.textured) {
+			texel = fetch_texels(p, au, av);
+
+			/* Texel 0000h is fully transparent. */
+			write = V::andnot(V::eq(texel, V::zero()), write);
+
+			V channel = V::set1(0x1f);
+			V tr = texel & channel, tg = (texel >> 5) & channel, tb = (texel >> 10) & channel;
+			if (p.raw_texture) {
+				r = tr << 3; g = tg << 3; b = tb << 3;
+			}
+			else {
+				V top = V::set1(255);
+				r = V::min((tr * r) >> 4, top);
+				g = V::min((tg * g) >> 4, top);
+				b = V::min((tb * b) >> 4, top);
+			}
+		}
+
+		if (p.dither) {
+			V offset = V::load32(dither);
+			r = clamp_color(r + offset);
+			g = clamp_color(g + offset);
+			b = clamp_color(b + offset);
+		}
+
+		V color = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10);
+
+		/* Textured primitives only blend texels with bit 15 set. */
+		if (p.semi_transparent) {
+			V blended = blend_lanes(back, color, p.semi_mode);
+			V lanes = p.textured ? V::andnot(V::eq(texel & bit15, V::zero()), V::ones()) : V::ones();
+			color = V::select(lanes, blended, color);
+		}
+
+		color = color | (texel & bit15) | set_mask;
+		V::store16(pixels, V::select(write, color, back));
+
+		if (count < 8)
+			std::memcpy(dest + i, tail, count * sizeof(ushort));
+
+		ar = ar + V::set1(span.dr * 8);
+		ag = ag + V::set1(span.dg * 8);
+		ab = ab + V::set1(span.db * 8);
+		au = au + V::set1(span.du * 8);
+		av = av + V::set1(span.dv * 8);
+	}
+}
@@ -0,0 +1,89 @@
+#include <stdafx.hpp>
+#include <smmintrin.h>
+
+#ifdef _MSC_VER
+#define SIMD_TARGET
+#else
+#define SIMD_TARGET __attribute__((target("sse4.1")))
+#endif
+
+#include "span_simd.h"
+
+/* Eight lanes in two XMM registers. SSE4.1 has no gathers */
+/* or per lane shifts, those go through memory. */
+struct SSE41Vector {
+	__m128i lo, hi;
+
+	SIMD_TARGET static SSE41Vector make(__m128i lo, __m128i hi) { return SSE41Vector{ lo, hi }; }
+	SIMD_TARGET static SSE41Vector zero() { return make(_mm_setzero_si128(), _mm_setzero_si128()); }
+	SIMD_TARGET static SSE41Vector ones() { return set1(-1); }
+	SIMD_TARGET static SSE41Vector set1(int value) { return make(_mm_set1_epi32(value), _mm_set1_epi32(value)); }
+	SIMD_TARGET static SSE41Vector iota() { return make(_mm_setr_epi32(0, 1, 2, 3), _mm_setr_epi32(4, 5, 6, 7)); }
+
+	SIMD_TARGET static SSE41Vector load32(const int* data)
+	{
+		return make(_mm_loadu_si128((const __m128i*)data), _mm_loadu_si128((const __m128i*)(data + 4)));
+	}
+
+	SIMD_TARGET static SSE41Vector load16(const ushort* data)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)data);
+		return make(_mm_cvtepu16_epi32(pixels), _mm_cvtepu16_epi32(_mm_srli_si128(pixels, 8)));
+	}
+
+	SIMD_TARGET static void store16(ushort* data, SSE41Vector value)
+	{
+		_mm_storeu_si128((__m128i*)data, _mm_packus_epi32(value.lo, value.hi));
+	}
+
+	SIMD_TARGET static SSE41Vector gather16(const ushort* base, SSE41Vector index)
+	{
+		alignas(16) int lanes[8];
+		_mm_store_si128((__m128i*)lanes, index.lo);
+		_mm_store_si128((__m128i*)(lanes + 4), index.hi);
+
+		for (int& lane : lanes)
+			lane = base[lane];
+
+		return load32(lanes);
+	}
+
+	SIMD_TARGET static SSE41Vector srlv(SSE41Vector a, SSE41Vector count)
+	{
+		alignas(16) int values[8], shifts[8];
+		_mm_store_si128((__m128i*)values, a.lo);
+		_mm_store_si128((__m128i*)(values + 4), a.hi);
+		_mm_store_si128((__m128i*)shifts, count.lo);
+		_mm_store_si128((__m128i*)(shifts + 4), count.hi);
+
+		for (int i = 0; i < 8; i++)
+			values[i] = (int)((uint)values[i] >> shifts[i]);
+
+		return load32(values);
+	}
+
+	SIMD_TARGET static SSE41Vector min(SSE41Vector a, SSE41Vector b) { return make(_mm_min_epi32(a.lo, b.lo), _mm_min_epi32(a.hi, b.hi)); }
+	SIMD_TARGET static SSE41Vector max(SSE41Vector a, SSE41Vector b) { return make(_mm_max_epi32(a.lo, b.lo), _mm_max_epi32(a.hi, b.hi)); }
+	SIMD_TARGET static SSE41Vector eq(SSE41Vector a, SSE41Vector b) { return make(_mm_cmpeq_epi32(a.lo, b.lo), _mm_cmpeq_epi32(a.hi, b.hi)); }
+	SIMD_TARGET static SSE41Vector gt(SSE41Vector a, SSE41Vector b) { return make(_mm_cmpgt_epi32(a.lo, b.lo), _mm_cmpgt_epi32(a.hi, b.hi)); }
+	SIMD_TARGET static SSE41Vector andnot(SSE41Vector a, SSE41Vector b) { return make(_mm_andnot_si128(a.lo, b.lo), _mm_andnot_si128(a.hi, b.hi)); }
+
+	SIMD_TARGET static SSE41Vector select(SSE41Vector mask, SSE41Vector a, SSE41Vector b)
+	{
+		return make(_mm_blendv_epi8(b.lo, a.lo, mask.lo), _mm_blendv_epi8(b.hi, a.hi, mask.hi));
+	}
+
+	SIMD_TARGET SSE41Vector sra(int shift) const { return make(_mm_srai_epi32(lo, shift), _mm_srai_epi32(hi, shift)); }
+	SIMD_TARGET SSE41Vector operator>>(int shift) const { return make(_mm_srli_epi32(lo, shift), _mm_srli_epi32(hi, shift)); }
+	SIMD_TARGET SSE41Vector operator<<(int shift) const { return make(_mm_slli_epi32(lo, shift), _mm_slli_epi32(hi, shift)); }
+	SIMD_TARGET SSE41Vector operator+(SSE41Vector b) const { return make(_mm_add_epi32(lo, b.lo), _mm_add_epi32(hi, b.hi)); }
+	SIMD_TARGET SSE41Vector operator-(SSE41Vector b) const { return make(_mm_sub_epi32(lo, b.lo), _mm_sub_epi32(hi, b.hi)); }
+	SIMD_TARGET SSE41Vector operator*(SSE41Vector b) const { return make(_mm_mullo_epi32(lo, b.lo), _mm_mullo_epi32(hi, b.hi)); }
+	SIMD_TARGET SSE41Vector operator&(SSE41Vector b) const { return make(_mm_and_si128(lo, b.lo), _mm_and_si128(hi, b.hi)); }
+	SIMD_TARGET SSE41Vector operator|(SSE41Vector b) const { return make(_mm_or_si128(lo, b.lo), _mm_or_si128(hi, b.hi)); }
+};
+
+SIMD_TARGET void span_sse41(const RasterPrimitive& p, const Span& span)
+{
+	span_simd<SSE41Vector>(p, span);
+}
@@ -1,8 +1,43 @@
 #include <stdafx.hpp>
 #include <glad/glad.h>
+#include <bit>
+#include <emmintrin.h>
 #include "opengl/stb_image.h"
-#include "opengl/stb_image_write.h"
 #include "vram.h"
+#include "vram_dump.h"
+
+/* Dumps are encoded away from the emulation thread. */
+static ImageWriter image_writer;
+
+/* Stores pixels that are not protected by the mask bit, */
+/* setting it on the way if asked to. */
+static void write_pixels(ushort* dest, const ushort* src, uint count, bool set_mask, bool check_mask)
+{
+	if (!set_mask && !check_mask) {
+		std::memcpy(dest, src, count * sizeof(ushort));
+		return;
+	}
+
+	__m128i mask = _mm_set1_epi16(set_mask ? (short)0x8000 : 0);
+	__m128i preserve = _mm_set1_epi16(check_mask ? (short)0x8000 : 0);
+
+	uint i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i old = _mm_loadu_si128((const __m128i*)(dest + i));
+		__m128i data = _mm_or_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask);
+
+		/* Spread the mask bit of protected pixels over the lane. */
+		__m128i keep = _mm_srai_epi16(_mm_and_si128(old, preserve), 15);
+		__m128i result = _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, data));
+		_mm_storeu_si128((__m128i*)(dest + i), result);
+	}
+
+	ushort set = set_mask ? 0x8000 : 0;
+	for (; i < count; i++) {
+		if (!(check_mask && (dest[i] & 0x8000)))
+			dest[i] = src[i] | set;
+	}
+}
 
 void VRAM::init()
 {
@@ -38,28 +73,97 @@ void VRAM::init()
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 
-	image_buffer = new ubyte[3 * 1024 * 512];
+	/* The texture starts out undefined. */
+	mark_dirty(0, 0, VRAM_WIDTH, VRAM_HEIGHT);
+}
+
+/* Keep VRAM in host memory when there is no GL context. */
+void VRAM::init_headless()
+{
+	if (ptr == nullptr)
+		ptr = new ushort[1024 * 512]();
 }
 
 void VRAM::upload_to_gpu()
 {
 	glBindTexture(GL_TEXTURE_RECTANGLE, texture);
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
-	glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, 1024, 512, GL_RED_INTEGER, GL_UNSIGNED_SHORT, 0);
-
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, VRAM_WIDTH);
+
+	for (int row = 0; row < VRAM_BLOCK_ROWS; row++) {
+		while (dirty[row] != 0) {
+			/* Take the first run of dirty blocks in the row. */
+			uint64_t mask = dirty[row];
+			int first = std::countr_zero(mask);
+			int count = std::countr_one(mask >> first);
+			uint64_t run = (count == 64 ? ~0ull : (1ull << count) - 1) << first;
+
+			/* Grow it down while the rows below have the same blocks dirty. */
+			int last = row;
+			while (last + 1 < VRAM_BLOCK_ROWS && (dirty[last + 1] & run) == run)
+				last++;
+
+			for (int i = row; i <= last; i++)
+				dirty[i] &= ~run;
+
+			int x = first * VRAM_BLOCK_SIZE;
+			int y = row * VRAM_BLOCK_SIZE;
+			int width = count * VRAM_BLOCK_SIZE;
+			int height = (last - row + 1) * VRAM_BLOCK_SIZE;
+
+			size_t offset = ((size_t)y * VRAM_WIDTH + x) * sizeof(ushort);
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, x, y, width, height, GL_RED_INTEGER, GL_UNSIGNED_SHORT, (void*)offset);
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
+/* Marks the blocks covering the rectangle, wrapping around the edges of VRAM. */
+void VRAM::mark_dirty(uint x, uint y, uint width, uint height)
+{
+	if (width == 0 || height == 0)
+		return;
+
+	constexpr uint columns = VRAM_WIDTH / VRAM_BLOCK_SIZE;
+	uint left = x % VRAM_WIDTH, top = y % VRAM_HEIGHT;
+
+	uint first = left / VRAM_BLOCK_SIZE;
+	uint count = std::min((left + width - 1) / VRAM_BLOCK_SIZE - first + 1, columns);
+	uint first_row = top / VRAM_BLOCK_SIZE;
+	uint rows = std::min((top + height - 1) / VRAM_BLOCK_SIZE - first_row + 1, (uint)VRAM_BLOCK_ROWS);
+
+	/* Rotate the run of blocks into place so it wraps horizontally. */
+	uint64_t run = count == columns ? ~0ull : (1ull << count) - 1;
+	run = std::rotl(run, (int)first);
+
+	for (uint i = 0; i < rows; i++)
+		dirty[(first_row + i) % VRAM_BLOCK_ROWS] |= run;
+}
+
 void VRAM::bind_vram_texture()
 {
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_RECTANGLE, texture);
 }
 
-void VRAM::write_to_image()
+void VRAM::write_to_image(const std::string& path)
 {
-	stbi_write_jpg("vram_dump.jpg", 1024, 512, 3, image_buffer, 100);
+	write_display_image(path, 0, 0, VRAM_WIDTH, VRAM_HEIGHT, false);
+}
+
+/* Only the snapshot is taken here, converting */
+/* and encoding happen on the writer thread. */
+void VRAM::write_display_image(const std::string& path, uint x, uint y, uint width, uint height, bool rgb24)
+{
+	if (width == 0 || height == 0)
+		return;
+
+	DumpRequest request = { path, std::vector<ushort>(ptr, ptr + VRAM_WIDTH * VRAM_HEIGHT),
+		x % VRAM_WIDTH, y % VRAM_HEIGHT, width, height, rgb24 };
+	image_writer.submit(std::move(request));
 }
 
 ushort VRAM::read(uint x, uint y)
@@ -73,9 +177,53 @@ void VRAM::write(uint x, uint y, ushort data)
 	int index = (y * 1024) + x;
 	ptr[index] = data;
 
-	image_buffer[index * 3 + 0] = (data << 3) & 0xf8;
-	image_buffer[index * 3 + 0] = (data >> 2) & 0xf8;
-	image_buffer[index * 3 + 0] = (data >> 7) & 0xf8;
+	dirty[(index >> 10) / VRAM_BLOCK_SIZE % VRAM_BLOCK_ROWS] |= 1ull << ((index & 1023) / VRAM_BLOCK_SIZE);
+}
+
+void VRAM::read_row(uint x, uint y, ushort* data, uint count)
+{
+	std::memcpy(data, ptr + y * VRAM_WIDTH + x, count * sizeof(ushort));
+}
+
+void VRAM::write_row(uint x, uint y, const ushort* data, uint count, bool set_mask, bool check_mask)
+{
+	write_pixels(ptr + y * VRAM_WIDTH + x, data, count, set_mask, check_mask);
+	mark_dirty(x, y, count, 1);
+}
+
+/* Copies rows top to bottom like the GPU does, so copying a */
+/* rectangle down over itself repeats rows. Each row reads its */
+/* source before writing, overlap within a row is safe. */
+void VRAM::copy_rect(uint src_x, uint src_y, uint dest_x, uint dest_y, uint width, uint height, bool set_mask, bool check_mask)
+{
+	src_x %= VRAM_WIDTH; dest_x %= VRAM_WIDTH;
+	width = std::min<uint>(width, VRAM_WIDTH);
+	height = std::min<uint>(height, VRAM_HEIGHT);
+
+	bool wraps = src_x + width > VRAM_WIDTH || dest_x + width > VRAM_WIDTH;
+	bool masked = set_mask || check_mask;
+
+	ushort buffer[VRAM_WIDTH];
+	for (uint y = 0; y < height; y++) {
+		ushort* src = ptr + ((src_y + y) % VRAM_HEIGHT) * VRAM_WIDTH;
+		ushort* dest = ptr + ((dest_y + y) % VRAM_HEIGHT) * VRAM_WIDTH;
+
+		if (!wraps && !masked) {
+			std::memmove(dest + dest_x, src + src_x, width * sizeof(ushort));
+			continue;
+		}
+
+		/* Split at the right edge of VRAM on either side. */
+		uint first = std::min(width, VRAM_WIDTH - src_x);
+		std::memcpy(buffer, src + src_x, first * sizeof(ushort));
+		std::memcpy(buffer + first, src, (width - first) * sizeof(ushort));
+
+		first = std::min(width, VRAM_WIDTH - dest_x);
+		write_pixels(dest + dest_x, buffer, first, set_mask, check_mask);
+		write_pixels(dest, buffer + first, width - first, set_mask, check_mask);
+	}
+
+	mark_dirty(dest_x, dest_y, width, height);
 }
 
 VRAM vram;
\ No newline at end of file
@@ -25,25 +25,43 @@ union TPageAttrib {
 constexpr int VRAM_WIDTH = 1024;
 constexpr int VRAM_HEIGHT = 512;
 
+/* Uploads to the GPU are tracked in square blocks of VRAM. */
+constexpr int VRAM_BLOCK_SIZE = 16;
+constexpr int VRAM_BLOCK_ROWS = VRAM_HEIGHT / VRAM_BLOCK_SIZE;
+
 class VRAM {
 public:
 	VRAM() = default;
 	~VRAM() = default;
 
 	void init();
+	void init_headless();
+	/* Uploads the blocks changed since the last upload. */
 	void upload_to_gpu();
+	void mark_dirty(uint x, uint y, uint width, uint height);
 
 	void bind_vram_texture();
-	void write_to_image();
+	/* Save VRAM, or the part of it on display, in the */
+	/* background. PNG paths are written losslessly. */
+	void write_to_image(const std::string& path = "vram_dump.jpg");
+	void write_display_image(const std::string& path, uint x, uint y, uint width, uint height, bool rgb24);
 
 	ushort read(uint x, uint y);
 	void write(uint x, uint y, ushort data);
 
+	/* Copy runs of pixels that stay within one row, and */
+	/* rectangles that wrap around the edges of VRAM. */
+	/* Writes are subject to the mask bit settings. */
+	void read_row(uint x, uint y, ushort* data, uint count);
+	void write_row(uint x, uint y, const ushort* data, uint count, bool set_mask, bool check_mask);
+	void copy_rect(uint src_x, uint src_y, uint dest_x, uint dest_y, uint width, uint height, bool set_mask, bool check_mask);
+
 public:
 	uint pbo, texture;
 	ushort* ptr;
 
-	ubyte* image_buffer;
+	/* One bit per dirty block, one word per row of blocks. */
+	uint64_t dirty[VRAM_BLOCK_ROWS];
 };
 
 extern VRAM vram;
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <stdafx.hpp>
+#include "vram_dump.h"
+#include <emmintrin.h>
+#include <video/vram.h>
+#include "opengl/stb_image_write.h"
+
+static inline void convert_pixel(ushort pixel, ubyte* dest)
+{
+	dest[0] = (pixel << 3) & 0xf8;
+	dest[1] = (pixel >> 2) & 0xf8;
+	dest[2] = (pixel >> 7) & 0xf8;
+}
+
+/* Widens four pixels to 0x00BBGGRR words. */
+static inline __m128i expand_pixels(__m128i pixels)
+{
+	__m128i r = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x001f)), 3);
+	__m128i g = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x03e0)), 6);
+	__m128i b = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x7c00)), 9);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+/* Writes four expanded pixels as twelve bytes. Each 64 bit half */
+/* is squeezed to six bytes and stored with eight byte writes, the */
+/* two extra bytes are overwritten by whatever is stored next. */
+static inline void store_pixels(ubyte* dest, __m128i rgb)
+{
+	__m128i low = _mm_set_epi32(0, 0xffffff, 0, 0xffffff);
+	rgb = _mm_or_si128(_mm_and_si128(rgb, low), _mm_srli_epi64(_mm_andnot_si128(low, rgb), 8));
+
+	_mm_storel_epi64((__m128i*)dest, rgb);
+	_mm_storel_epi64((__m128i*)(dest + 6), _mm_unpackhi_epi64(rgb, rgb));
+}
+
+void convert_15bit(const ushort* src, ubyte* dest, uint count)
+{
+	uint i = 0;
+
+	/* Only while a pixel follows to cover the overhanging bytes. */
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 8 < count; i += 8, dest += 24) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+		store_pixels(dest, expand_pixels(_mm_unpacklo_epi16(pixels, zero)));
+		store_pixels(dest + 12, expand_pixels(_mm_unpackhi_epi16(pixels, zero)));
+	}
+
+	for (; i < count; i++, dest += 3)
+		convert_pixel(src[i], dest);
+}
+
+void convert_24bit(const ushort* row, uint x, ubyte* dest, uint count)
+{
+	constexpr uint row_bytes = VRAM_WIDTH * sizeof(ushort);
+	const ubyte* bytes = (const ubyte*)row;
+
+	uint start = (x * 2) % row_bytes;
+	uint size = std::min(count * 3, row_bytes);
+	uint first = std::min(size, row_bytes - start);
+
+	std::memcpy(dest, bytes + start, first);
+	std::memcpy(dest + first, bytes, size - first);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+
+	/* The writer drains the queue before it exits. */
+	wake.notify_one();
+	if (writer.joinable())
+		writer.join();
+}
+
+void ImageWriter::submit(DumpRequest&& request)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(std::move(request));
+
+		if (!running) {
+			running = true;
+			writer = std::thread(&ImageWriter::writer_loop, this);
+		}
+	}
+
+	wake.notify_one();
+}
+
+void ImageWriter::writer_loop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true) {
+		wake.wait(guard, [&] { return !queue.empty() || !running; });
+		if (queue.empty())
+			break;
+
+		DumpRequest request = std::move(queue.front());
+		queue.pop_front();
+
+		guard.unlock();
+		write(request);
+		guard.lock();
+	}
+}
+
+void ImageWriter::write(const DumpRequest& request)
+{
+	std::vector<ubyte> image(request.width * request.height * 3);
+
+	for (uint y = 0; y < request.height; y++) {
+		const ushort* row = request.pixels.data() + ((request.y + y) % VRAM_HEIGHT) * VRAM_WIDTH;
+		ubyte* dest = image.data() + y * request.width * 3;
+
+		if (request.rgb24) {
+			convert_24bit(row, request.x, dest, request.width);
+			continue;
+		}
+
+		/* Rows wrap around the right edge of VRAM. */
+		uint first = std::min(request.width, VRAM_WIDTH - request.x);
+		convert_15bit(row + request.x, dest, first);
+		convert_15bit(row, dest + first * 3, request.width - first);
+	}
+
+	auto& path = request.path;
+	bool png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+
+	int width = request.width, height = request.height;
+	int result = png ? stbi_write_png(path.c_str(), width, height, 3, image.data(), width * 3) :
+		stbi_write_jpg(path.c_str(), width, height, 3, image.data(), 100);
+
+	if (result == 0)
+		printf("[VRAM] Failed to write %s.\n", path.c_str());
+}
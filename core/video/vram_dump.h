@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* Convert one row of pixels to RGB888. */
+void convert_15bit(const ushort* src, ubyte* dest, uint count);
+/* In 24 bit display mode VRAM rows already hold RGB888 */
+/* bytes, x is in halfwords and reads wrap within the row. */
+void convert_24bit(const ushort* row, uint x, ubyte* dest, uint count);
+
+/* A snapshot of VRAM waiting to be encoded. */
+struct DumpRequest {
+	std::string path;
+	std::vector<ushort> pixels;
+	uint x, y, width, height;
+	bool rgb24;
+};
+
+/* Converts and encodes VRAM snapshots on a background thread, */
+/* as JPEG or as lossless PNG when the path ends in .png. */
+class ImageWriter {
+public:
+	ImageWriter() = default;
+	~ImageWriter();
+
+	void submit(DumpRequest&& request);
+
+private:
+	void writer_loop();
+	void write(const DumpRequest& request);
+
+private:
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<DumpRequest> queue;
+	std::thread writer;
+	bool running = false;
+};
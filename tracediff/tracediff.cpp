@@ -0,0 +1,184 @@
+#include <stdafx.hpp>
+#include <cpu/trace_format.h>
+#include <utility/mapped_file.hpp>
+#include <emmintrin.h>
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Compares two execution traces written by the CPU tracer and */
+/* reports the first instruction where they diverge. Traces of */
+/* identical runs have byte-identical blocks, so blocks are */
+/* compared encoded and only the first differing one is decoded. */
+
+static uint lowest_bit(uint mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/* Offset of the first differing byte, or size if equal. */
+static size_t first_mismatch(const ubyte* a, const ubyte* b, size_t size)
+{
+	size_t offset = 0;
+
+	/* Compare 64 bytes per iteration, then find the byte. */
+	for (; offset + 64 <= size; offset += 64) {
+		__m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + offset)), _mm_loadu_si128((const __m128i*)(b + offset)));
+		__m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + offset + 16)), _mm_loadu_si128((const __m128i*)(b + offset + 16)));
+		__m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + offset + 32)), _mm_loadu_si128((const __m128i*)(b + offset + 32)));
+		__m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + offset + 48)), _mm_loadu_si128((const __m128i*)(b + offset + 48)));
+
+		__m128i all = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+		if (_mm_movemask_epi8(all) == 0xffff)
+			continue;
+
+		__m128i eq[4] = { eq0, eq1, eq2, eq3 };
+		for (int i = 0; i < 4; i++) {
+			uint diff = ~(uint)_mm_movemask_epi8(eq[i]) & 0xffff;
+			if (diff != 0)
+				return offset + i * 16 + lowest_bit(diff);
+		}
+	}
+
+	for (; offset < size; offset++) {
+		if (a[offset] != b[offset])
+			break;
+	}
+
+	return offset;
+}
+
+static void print_record(const char* name, const TraceRecord& record)
+{
+	std::printf("  %-9s pc %08x instr %08x", name, record.pc, record.instr);
+	if (record.reg != 0)
+		std::printf("  r%u = %08x", record.reg, record.value);
+	if (record.access)
+		std::printf("  [%08x]", record.addr);
+	std::printf("\n");
+}
+
+/* Walks the blocks of a mapped trace. */
+struct TraceReader {
+	MappedFile file;
+	size_t offset = sizeof(TraceHeader);
+
+	bool open(const char* path)
+	{
+		if (!file.open(path)) {
+			std::fprintf(stderr, "cannot open %s\n", path);
+			return false;
+		}
+
+		TraceHeader header;
+		if (file.size < sizeof(header)) {
+			std::fprintf(stderr, "%s is not a trace\n", path);
+			return false;
+		}
+
+		std::memcpy(&header, file.data, sizeof(header));
+		if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+			header.block_records != TRACE_BLOCK_RECORDS) {
+			std::fprintf(stderr, "%s is not a version %u trace\n", path, TRACE_VERSION);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool at_end() const
+	{
+		return offset + sizeof(TraceBlockHeader) > file.size;
+	}
+
+	/* Returns false at the end or on a truncated block. */
+	bool next(TraceBlockHeader& header, const ubyte*& payload)
+	{
+		if (at_end())
+			return false;
+
+		std::memcpy(&header, file.data + offset, sizeof(header));
+		if (header.size > file.size - offset - sizeof(header))
+			return false;
+
+		payload = file.data + offset + sizeof(header);
+		offset += sizeof(header) + header.size;
+		return true;
+	}
+};
+
+int main(int argc, char** argv)
+{
+	if (argc != 3) {
+		std::fprintf(stderr, "usage: tracediff <reference> <trace>\n");
+		return 2;
+	}
+
+	TraceReader reference, trace;
+	if (!reference.open(argv[1]) || !trace.open(argv[2]))
+		return 2;
+
+	ulong index = 0;
+	std::vector<TraceRecord> expected, actual;
+
+	while (true) {
+		TraceBlockHeader a, b;
+		const ubyte* pa = nullptr;
+		const ubyte* pb = nullptr;
+
+		bool has_a = reference.next(a, pa);
+		bool has_b = trace.next(b, pb);
+
+		if (!has_a || !has_b) {
+			if (!has_a && !has_b) {
+				std::printf("traces match, %llu instructions\n", (unsigned long long)index);
+				return 0;
+			}
+
+			std::printf("%s ends after %llu instructions\n", (has_a ? argv[2] : argv[1]),
+				(unsigned long long)index);
+			return 1;
+		}
+
+		if (a.records == b.records && a.size == b.size && first_mismatch(pa, pb, a.size) == a.size) {
+			index += a.records;
+			continue;
+		}
+
+		/* Decode the differing block to find the instruction. */
+		expected.clear();
+		actual.clear();
+		if (!decode_trace_block(pa, a.size, a.records, expected) ||
+			!decode_trace_block(pb, b.size, b.records, actual)) {
+			std::fprintf(stderr, "corrupt block at instruction %llu\n", (unsigned long long)index);
+			return 2;
+		}
+
+		size_t count = std::min(expected.size(), actual.size());
+		size_t i = 0;
+		while (i < count && expected[i] == actual[i])
+			i++;
+
+		if (i == count) {
+			std::printf("%s ends after %llu instructions\n",
+				(expected.size() < actual.size() ? argv[1] : argv[2]), (unsigned long long)(index + i));
+			return 1;
+		}
+
+		std::printf("traces diverge at instruction %llu\n", (unsigned long long)(index + i));
+		if (i > 0)
+			print_record("previous", expected[i - 1]);
+
+		print_record("reference", expected[i]);
+		print_record("trace", actual[i]);
+		return 1;
+	}
+}